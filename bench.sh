@@ -0,0 +1,102 @@
+#!/bin/bash -e
+
+# Throughput benchmark: generates large synthetic meshes and times obj-magic on them.
+# Results are written as TSV (default: bench/results.tsv, or the first argument).
+#
+# Environment:
+#   BENCH_VERTICES  approximate vertex count per generated mesh (default 2000000)
+#   BENCH_REPEAT    runs per measurement, fastest one is kept (default 3)
+#   BENCH_DATADIR   directory for generated meshes, kept between runs if given
+#   BENCH_FILTER    only run operations whose name matches this regex
+
+DIR=$(dirname $(readlink -f $0))
+BIN="$DIR/obj-magic"
+BENCHBIN="$DIR/bench/objbench"
+PARSEBIN="$DIR/bench/parsebench"
+RESULTS=${1:-"$DIR/bench/results.tsv"}
+VERTICES=${BENCH_VERTICES:-2000000}
+REPEAT=${BENCH_REPEAT:-3}
+
+WORKLOADS="grid scan materials crlf relative"
+
+# Operation name and the obj-magic parameters it runs with, @DATADIR@ is the mesh directory
+# and @MESH@ the mesh itself (which is also always given last)
+OPERATIONS=(
+	"passthrough|--scale 1"
+	"info|--info"
+	"normalize-normals|--normalize-normals"
+	"invert-normals|--invert-normals"
+	"center|--center"
+	"scale|--scale 0.5"
+	"scaleuv|--scaleuv 2"
+	"invertuv|--invertuv"
+	"mirror|--mirror"
+	"translate|--translate 10"
+	"rotate|--rotatey 45"
+	"fit|--fit 1"
+	"resize|--resize 2"
+	"indexed|--indexed --scale 0.5"
+	"clean|--clean"
+	"dedupe|--dedupe"
+	"weld|--weld 0.001"
+	"triangulate|--triangulate"
+	"auto-normals|--auto-normals"
+	"optimize-vertex-cache|--optimize-vertex-cache"
+	"optimize-overdraw|--optimize-vertex-cache --optimize-overdraw 1.05"
+	"optimize-vertex-fetch|--optimize-vertex-fetch"
+	"delete-material|--delete-material material_7 --delete-group rows_0"
+	"simplify|--simplify 0.25"
+	"cluster-decimate|--cluster-decimate 0.25"
+	"remove-redundant|--remove-degenerate --remove-duplicate-faces"
+	"lod-chain|--lod-chain 0.5,0.25,0.1"
+	"max-vertices|--max-vertices 65535"
+	"meshlets|--meshlets @DATADIR@/meshlets.bin"
+	"split-by|--split-by material -o @DATADIR@/split.obj"
+	"merge|--merge --prefix-names @MESH@"
+	"optimize-materials|--optimize-materials"
+)
+
+if [ ! -x "$BIN" ]; then
+	echo "$BIN not found, run ./make.sh first"
+	exit 1
+fi
+
+CXX=${CXX:-g++}
+$CXX -O2 -std=c++14 -Wall -Wextra "$DIR/bench/objbench.cpp" -o "$BENCHBIN"
+$CXX -O2 -std=c++14 -Wall -Wextra "$DIR/bench/parsebench.cpp" -o "$PARSEBIN"
+
+if [ "$BENCH_DATADIR" ]; then
+	DATADIR="$BENCH_DATADIR"
+	mkdir -p "$DATADIR"
+else
+	DATADIR=`mktemp -dt obj-magic-bench.XXXXXXXX`
+	trap 'rm -rf "$DATADIR"' EXIT
+fi
+
+"$BENCHBIN" header > "$RESULTS"
+for workload in $WORKLOADS; do
+	MESH="$DATADIR/$workload-$VERTICES.obj"
+	if [ ! -f "$MESH" ]; then
+		echo "Generating $workload mesh with ~$VERTICES vertices..."
+		"$BENCHBIN" gen $workload $VERTICES "$MESH"
+	fi
+	for op in "${OPERATIONS[@]}"; do
+		name=${op%%|*}
+		params=${op#*|}
+		params=${params//@DATADIR@/$DATADIR}
+		params=${params//@MESH@/$MESH}
+		if [ "$BENCH_FILTER" ] && ! [[ "$name" =~ $BENCH_FILTER ]]; then
+			continue
+		fi
+		echo -n "Benchmarking $workload/$name..."
+		"$BENCHBIN" run -r $REPEAT $workload $name "$MESH" -- "$BIN" $params "$MESH" | tee -a "$RESULTS" | cut -f 5 | tr -d '\n'
+		echo " MB/s"
+	done
+	# Parser micro benchmarks, timed in-process
+	if [ -z "$BENCH_FILTER" ] || [[ "parse" =~ $BENCH_FILTER ]]; then
+		echo "Benchmarking $workload parsers..."
+		"$PARSEBIN" $workload "$MESH" $REPEAT | tee -a "$RESULTS" | cut -f 2,5
+	fi
+done
+
+echo "Results written to $RESULTS"
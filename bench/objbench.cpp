@@ -0,0 +1,281 @@
+// Benchmark helper for obj-magic.
+//
+// gen: deterministically writes large synthetic OBJ meshes
+// run: executes a command and reports wall time and peak memory as a TSV row
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdarg>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Small deterministic PRNG so generated meshes are identical on every machine
+struct Random {
+	uint64_t state;
+	explicit Random(uint64_t seed): state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+	uint32_t next() {
+		state ^= state >> 12; state ^= state << 25; state ^= state >> 27;
+		return (uint32_t)((state * 0x2545F4914F6CDD1Dull) >> 32);
+	}
+	float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+class Writer {
+public:
+	Writer(FILE* file, bool crlf): file(file), eol(crlf ? "\r\n" : "\n") { buffer.reserve(1 << 20); }
+	~Writer() { flush(); }
+
+	void line(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+		char tmp[256];
+		va_list ap;
+		va_start(ap, fmt);
+		int len = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+		va_end(ap);
+		buffer.append(tmp, len);
+		buffer.append(eol);
+		if (buffer.size() > (1 << 20) - 512) flush();
+	}
+
+	void flush() {
+		fwrite(buffer.data(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+
+private:
+	FILE* file;
+	const char* eol;
+	std::string buffer;
+};
+
+// Smooth value noise used to fake scanned surfaces
+static float hash2(int x, int y) {
+	uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return ((h ^ (h >> 16)) & 0xffffff) * (1.0f / 16777216.0f);
+}
+
+static float valueNoise(float x, float y) {
+	int ix = (int)std::floor(x), iy = (int)std::floor(y);
+	float fx = x - ix, fy = y - iy;
+	fx = fx * fx * (3 - 2 * fx);
+	fy = fy * fy * (3 - 2 * fy);
+	float a = hash2(ix, iy), b = hash2(ix + 1, iy), c = hash2(ix, iy + 1), d = hash2(ix + 1, iy + 1);
+	return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fy;
+}
+
+static float height(float x, float y) {
+	return valueNoise(x * 0.01f, y * 0.01f) * 40.0f + valueNoise(x * 0.1f, y * 0.1f) * 4.0f;
+}
+
+// Regular textured grid of quads with per-vertex normals
+static void genGrid(Writer& out, unsigned side) {
+	out.line("# obj-magic benchmark grid %ux%u", side, side);
+	out.line("mtllib grid.mtl");
+	out.line("o grid");
+	for (unsigned j = 0; j < side; ++j)
+		for (unsigned i = 0; i < side; ++i)
+			out.line("v %.6f %.6f %.6f", i * 0.1f, 0.0f, j * 0.1f);
+	for (unsigned j = 0; j < side; ++j)
+		for (unsigned i = 0; i < side; ++i)
+			out.line("vt %.6f %.6f", i / float(side - 1), j / float(side - 1));
+	for (unsigned j = 0; j < side; ++j)
+		for (unsigned i = 0; i < side; ++i)
+			out.line("vn %.4f %.4f %.4f", 0.0f, 1.0f, 0.0f);
+	out.line("usemtl grid");
+	out.line("s off");
+	for (unsigned j = 0; j + 1 < side; ++j) {
+		for (unsigned i = 0; i + 1 < side; ++i) {
+			unsigned a = j * side + i + 1, b = a + 1, c = a + side + 1, d = a + side;
+			out.line("f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u", a, a, a, b, b, b, c, c, c, d, d, d);
+		}
+	}
+}
+
+// Noisy heightfield with long float literals, jitter and no texture coords
+static void genScan(Writer& out, unsigned side) {
+	Random rnd(1234);
+	out.line("# obj-magic benchmark scan %ux%u", side, side);
+	out.line("o scan");
+	for (unsigned j = 0; j < side; ++j) {
+		for (unsigned i = 0; i < side; ++i) {
+			float x = i + (rnd.uniform() - 0.5f) * 0.3f;
+			float z = j + (rnd.uniform() - 0.5f) * 0.3f;
+			out.line("v %.9g %.9g %.9g", x * 0.01f, height(x, z) * 0.01f + rnd.uniform() * 1e-4f, z * 0.01f);
+		}
+	}
+	for (unsigned j = 0; j < side; ++j) {
+		for (unsigned i = 0; i < side; ++i) {
+			float dx = height(i + 1.0f, (float)j) - height(i - 1.0f, (float)j);
+			float dz = height((float)i, j + 1.0f) - height((float)i, j - 1.0f);
+			float len = std::sqrt(dx * dx + 4.0f + dz * dz);
+			out.line("vn %.9g %.9g %.9g", -dx / len, 2.0f / len, -dz / len);
+		}
+	}
+	for (unsigned j = 0; j + 1 < side; ++j) {
+		for (unsigned i = 0; i + 1 < side; ++i) {
+			unsigned a = j * side + i + 1, b = a + 1, c = a + side + 1, d = a + side;
+			out.line("f %u//%u %u//%u %u//%u", a, a, b, b, c, c);
+			out.line("f %u//%u %u//%u %u//%u", a, a, c, c, d, d);
+		}
+	}
+}
+
+// Position-only grid split into groups with very frequent material switches
+static void genMaterials(Writer& out, unsigned side) {
+	Random rnd(42);
+	out.line("# obj-magic benchmark materials %ux%u", side, side);
+	out.line("mtllib materials.mtl");
+	for (unsigned j = 0; j < side; ++j)
+		for (unsigned i = 0; i < side; ++i)
+			out.line("v %.4f %.4f %.4f", i * 0.5f, (i ^ j) % 7 * 0.05f, j * 0.5f);
+	unsigned run = 0;
+	for (unsigned j = 0; j + 1 < side; ++j) {
+		if (j % 64 == 0) out.line("g rows_%u", j);
+		for (unsigned i = 0; i + 1 < side; ++i) {
+			if (run == 0) {
+				out.line("usemtl material_%u", rnd.next() % 64);
+				run = 1 + rnd.next() % 16;
+			}
+			--run;
+			unsigned a = j * side + i + 1, b = a + 1, c = a + side + 1, d = a + side;
+			out.line("f %u %u %u %u", a, b, c, d);
+		}
+	}
+}
+
+// Streaming exporter style: every quad writes its own attributes and refers to them
+// with negative indices, cycling through all tuple forms, plus some l and p records
+static void genRelative(Writer& out, unsigned side) {
+	out.line("# obj-magic benchmark relative %ux%u", side, side);
+	out.line("o relative");
+	for (unsigned j = 0; j + 1 < side; ++j) {
+		for (unsigned i = 0; i + 1 < side; ++i) {
+			float x = i * 0.25f, z = j * 0.25f;
+			out.line("v %.6f %.6f %.6f", x, 0.0f, z);
+			out.line("v %.6f %.6f %.6f", x + 0.25f, 0.0f, z);
+			out.line("v %.6f %.6f %.6f", x + 0.25f, 0.0f, z + 0.25f);
+			out.line("v %.6f %.6f %.6f", x, 0.0f, z + 0.25f);
+			out.line("vt 0 0");
+			out.line("vt 1 0");
+			out.line("vt 1 1");
+			out.line("vt 0 1");
+			out.line("vn 0 1 0");
+			switch ((i + j) % 4) {
+				case 0: out.line("f -4 -3 -2 -1"); break;
+				case 1: out.line("f -4/-4 -3/-3 -2/-2 -1/-1"); break;
+				case 2: out.line("f -4//-1 -3//-1 -2//-1 -1//-1"); break;
+				default: out.line("f -4/-4/-1 -3/-3/-1 -2/-2/-1 -1/-1/-1"); break;
+			}
+			if (i % 16 == 0) out.line("l -4 -3 -2");
+			if (i % 32 == 0) out.line("p -1");
+		}
+	}
+}
+
+static int generate(const std::string& shape, unsigned long long vertices, const std::string& path) {
+	unsigned side = (unsigned)std::ceil(std::sqrt((double)vertices));
+	if (side < 2) side = 2;
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cerr << "Failed to open file " << path << " for output" << std::endl;
+		return EXIT_FAILURE;
+	}
+	{
+		Writer out(file, shape == "crlf");
+		if (shape == "grid" || shape == "crlf") genGrid(out, side);
+		else if (shape == "scan") genScan(out, side);
+		else if (shape == "materials") genMaterials(out, side);
+		else if (shape == "relative") genRelative(out, side / 2);
+		else {
+			std::cerr << "Unknown shape " << shape << std::endl;
+			fclose(file);
+			return EXIT_FAILURE;
+		}
+	}
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+// Runs the command a number of times, keeping the fastest run
+static int run(const std::string& workload, const std::string& operation, const std::string& input, int repeat, char* argv[]) {
+	struct stat st;
+	if (stat(input.c_str(), &st) != 0) {
+		std::cerr << "Failed to open file " << input << std::endl;
+		return EXIT_FAILURE;
+	}
+	double best = 0;
+	long peakKb = 0;
+	for (int i = 0; i < repeat; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		pid_t pid = fork();
+		if (pid < 0) {
+			std::cerr << "fork failed" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (pid == 0) {
+			int devnull = open("/dev/null", O_WRONLY);
+			dup2(devnull, STDOUT_FILENO);
+			execvp(argv[0], argv);
+			_exit(127);
+		}
+		int status = 0;
+		struct rusage usage;
+		wait4(pid, &status, 0, &usage);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			std::cerr << "Command failed for " << workload << "/" << operation << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (i == 0 || elapsed < best) best = elapsed;
+		if (usage.ru_maxrss > peakKb) peakKb = usage.ru_maxrss;
+	}
+	double mb = st.st_size / (1024.0 * 1024.0);
+	printf("%s\t%s\t%lld\t%.4f\t%.2f\t%ld\n", workload.c_str(), operation.c_str(),
+		(long long)st.st_size, best, best > 0 ? mb / best : 0.0, peakKb);
+	return EXIT_SUCCESS;
+}
+
+static void usage(const char* app) {
+	std::cerr << "Usage: " << app << " gen SHAPE VERTICES FILE" << std::endl;
+	std::cerr << "       " << app << " run [-r REPEAT] WORKLOAD OPERATION INPUT -- COMMAND [ARG...]" << std::endl;
+	std::cerr << "       " << app << " header" << std::endl;
+	std::cerr << "Shapes: grid, scan, materials, crlf, relative" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string mode = argv[1];
+	if (mode == "header") {
+		printf("workload\toperation\tbytes\tseconds\tmb_per_s\tpeak_rss_kb\n");
+		return EXIT_SUCCESS;
+	}
+	if (mode == "gen" && argc == 5)
+		return generate(argv[2], strtoull(argv[3], nullptr, 10), argv[4]);
+	if (mode == "run") {
+		int i = 2, repeat = 1;
+		if (i + 1 < argc && std::string(argv[i]) == "-r") {
+			repeat = std::max(1, atoi(argv[i + 1]));
+			i += 2;
+		}
+		if (i + 4 < argc && std::string(argv[i + 3]) == "--")
+			return run(argv[i], argv[i + 1], argv[i + 2], repeat, argv + i + 4);
+	}
+	usage(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+// Micro benchmark of the record parsers in src/parse.hpp.
+// Prints TSV rows in the same format as objbench run.
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include "../src/parse.hpp"
+
+using namespace objmagic;
+
+struct Line {
+	const char* text;
+	size_t length;
+};
+
+static volatile uint64_t checksum;
+
+template<typename Function>
+static void measure(const std::string& workload, const std::string& operation, size_t bytes, int repeat, Function function) {
+	double best = 0;
+	for (int i = 0; i < repeat; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i == 0 || elapsed < best) best = elapsed;
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double mb = bytes / (1024.0 * 1024.0);
+	printf("%s\t%s\t%llu\t%.4f\t%.2f\t%ld\n", workload.c_str(), operation.c_str(),
+		(unsigned long long)bytes, best, best > 0 ? mb / best : 0.0, usage.ru_maxrss);
+	fflush(stdout);
+}
+
+template<typename Index>
+static uint64_t parseFaces(const std::vector<Line>& lines) {
+	ElementCounts counts;
+	Index tuples[3 * 64];
+	uint64_t sum = 0;
+	for (const Line& line : lines) {
+		const char* p = line.text;
+		if (p[0] == 'v') {
+			// Only counted to resolve relative indices
+			if (p[1] == ' ') ++counts.v;
+			else if (p[1] == 't') ++counts.vt;
+			else ++counts.vn;
+			continue;
+		}
+		int n = parseIndexTuples<Index>(p + 2, p + line.length, counts, tuples, 64);
+		for (int i = 0; i < n && i < 64; ++i)
+			sum += tuples[i * 3];
+	}
+	return sum;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " WORKLOAD FILE [REPEAT]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string workload = argv[1];
+	int repeat = argc > 3 ? std::max(1, atoi(argv[3])) : 1;
+	FILE* file = fopen(argv[2], "rb");
+	if (!file) {
+		std::cerr << "Failed to open file " << argv[2] << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::vector<char> data;
+	char block[1 << 16];
+	size_t got;
+	while ((got = fread(block, 1, sizeof(block), file)) > 0)
+		data.insert(data.end(), block, block + got);
+	fclose(file);
+	data.push_back('\0');
+
+	// Split once up front so only the parsers are timed
+	std::vector<Line> vertexLines, faceLines;
+	size_t vertexBytes = 0, faceBytes = 0;
+	for (const char* p = &data[0], *end = p + data.size() - 1; p < end; ) {
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		size_t len = nl ? nl - p : end - p;
+		Line line = { p, len && p[len - 1] == '\r' ? len - 1 : len };
+		if (len > 2 && p[0] == 'v' && (p[1] == ' ' || p[2] == ' ')) {
+			vertexLines.push_back(line);
+			faceLines.push_back(line);
+			vertexBytes += len + 1;
+		} else if (len > 2 && (p[0] == 'f' || p[0] == 'l' || p[0] == 'p') && p[1] == ' ') {
+			faceLines.push_back(line);
+			faceBytes += len + 1;
+		}
+		p += len + 1;
+	}
+
+	measure(workload, "parse-vertices", vertexBytes, repeat, [&]() {
+		float sum = 0, values[3];
+		for (const Line& line : vertexLines) {
+			int n = parseFloats(line.text + (line.text[1] == ' ' ? 2 : 3), values, 3);
+			for (int i = 0; i < n; ++i) sum += values[i];
+		}
+		checksum += (uint64_t)sum;
+	});
+	measure(workload, "parse-vertices-strtof", vertexBytes, repeat, [&]() {
+		float sum = 0;
+		for (const Line& line : vertexLines) {
+			const char* p = line.text + (line.text[1] == ' ' ? 2 : 3);
+			for (int i = 0; i < 3; ++i) {
+				char* end;
+				float value = strtof(p, &end);
+				if (end == p) break;
+				sum += value;
+				p = end;
+			}
+		}
+		checksum += (uint64_t)sum;
+	});
+	measure(workload, "parse-faces32", faceBytes, repeat, [&]() { checksum += parseFaces<uint32_t>(faceLines); });
+	measure(workload, "parse-faces64", faceBytes, repeat, [&]() { checksum += parseFaces<uint64_t>(faceLines); });
+	return EXIT_SUCCESS;
+}
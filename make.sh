@@ -1,7 +1,14 @@
 #!/bin/sh
 
 EXENAME="obj-magic"
-CFLAGS="-O2 -std=c++14 -Wall -Wextra -Wno-unused-parameter"
+LIBNAME="libobjmagic.a"
+BUILDDIR="build"
+CFLAGS="-O2 -std=c++14 -pthread -Wall -Wextra -Wno-unused-parameter"
+
+# Meshes with 2^32 or more elements need 64-bit indices in memory: INDEX64=1 ./make.sh
+if [ "x$INDEX64" != "x" ]; then
+	CFLAGS="$CFLAGS -DOBJMAGIC_64BIT_INDICES"
+fi
 
 if [ "x$CXX" = "x" ]; then
 	# Default to GCC
@@ -13,6 +20,13 @@ if [ "x$CXX" = "x" ]; then
 	fi
 fi
 
-set -x
-$CXX $CFLAGS src/*.cpp -o $EXENAME
-
+set -ex
+rm -rf $BUILDDIR
+mkdir -p $BUILDDIR
+# Everything except the command line frontend goes to the library
+for src in `ls src/*.cpp | grep -v src/$EXENAME.cpp`; do
+	$CXX $CFLAGS -c $src -o $BUILDDIR/`basename $src .cpp`.o
+done
+rm -f $LIBNAME
+ar rcs $LIBNAME $BUILDDIR/*.o
+$CXX $CFLAGS src/$EXENAME.cpp $LIBNAME -o $EXENAME
@@ -15,6 +15,17 @@ export TEMPDIR=`mktemp -dt obj-magic-testing.XXXXXXXX`
 LOGFILE="$TEMPDIR/test.log"
 FAILS=0
 
+# Performance tier: --perf compares against the stored baseline,
+# --perf-baseline re-measures and stores a new one
+PERF=""
+case "$1" in
+	--perf) PERF="check" ;;
+	--perf-baseline) PERF="update" ;;
+esac
+export BENCH_VERTICES=${BENCH_VERTICES:-300000}
+PERF_BASELINE="$DIR/bench/baseline.tsv"
+PERF_TOLERANCE=${PERF_TOLERANCE:-25}
+
 echo "Starting tests @ $HOSTNAME on `date -R`"
 echo "Starting tests @ $HOSTNAME on `date -R`" > "$LOGFILE"
 
@@ -45,9 +56,58 @@ function run_tests {
 	return $FAILS
 }
 
+# Fails if any throughput dropped or peak memory grew more than
+# PERF_TOLERANCE percent compared to the baseline (1 MB memory slack)
+function run_perf {
+	local perfdir=`mktemp -dt obj-magic-perf.XXXXXXXX`
+	local results="$perfdir/bench.tsv"
+	echo "Running performance tier with ~$BENCH_VERTICES vertices per mesh"
+	if ! "$DIR/bench.sh" "$results" > "$perfdir/bench.log" 2>&1; then
+		echo -e "${COLOR_RED}Benchmark failed, log kept in $perfdir${COLOR_OFF}"
+		return 1
+	fi
+	if [ "$PERF" = "update" ]; then
+		cp "$results" "$PERF_BASELINE"
+		echo "Baseline written to $PERF_BASELINE"
+		rm -rf "$perfdir"
+		return 0
+	fi
+	if [ ! -f "$PERF_BASELINE" ]; then
+		echo -e "${COLOR_RED}No baseline in $PERF_BASELINE, create one with --perf-baseline${COLOR_OFF}"
+		return 1
+	fi
+	awk -F '\t' -v tol=$PERF_TOLERANCE -v red="$COLOR_RED" -v off="$COLOR_OFF" '
+		FNR == 1 { next }
+		NR == FNR { speed[$1 "/" $2] = $5; mem[$1 "/" $2] = $6; next }
+		{
+			key = $1 "/" $2
+			if (!(key in speed)) { printf "%s: no baseline, skipped\n", key; next }
+			status = "OK"
+			if ($5 < speed[key] * (1 - tol / 100)) status = "SLOWER"
+			else if ($6 > mem[key] * (1 + tol / 100) + 1024) status = "MORE MEMORY"
+			if (status != "OK") { status = red status off; fails++ }
+			printf "%-32s %9.2f MB/s (baseline %9.2f) %9d KB (baseline %9d) %s\n", key, $5, speed[key], $6, mem[key], status
+		}
+		END { exit fails > 0 }
+	' "$PERF_BASELINE" "$results"
+	if [ $? -ne 0 ]; then
+		echo -e "${COLOR_RED}Performance regressed beyond ${PERF_TOLERANCE}%${COLOR_OFF}"
+		echo "Results kept in $perfdir"
+		return 1
+	fi
+	echo "Performance within ${PERF_TOLERANCE}% of baseline"
+	rm -rf "$perfdir"
+	return 0
+}
+
 time run_tests
 EXITCODE=$?
 
+if [ "$PERF" ] && [ $EXITCODE -eq 0 ]; then
+	run_perf
+	EXITCODE=$?
+fi
+
 if [ $EXITCODE -gt 0 ] && [ "$CI" = "true" ]; then
 	echo "CI environment detected, dumping test file contents from \"$TEMPDIR\":"
 	cd "$TEMPDIR"
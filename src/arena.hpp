@@ -0,0 +1,99 @@
+#pragma once
+
+// Bump allocator for the indexed mesh and the arrays living in it.
+// Memory is only returned when the arena is destroyed, so arrays should be
+// reserved to their final size up front.
+
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#define ARENA_MIN_BLOCK (64 << 10)
+#define ARENA_BLOCK (4 << 20)
+
+class Arena {
+public:
+	Arena() {}
+	~Arena() { clear(); }
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t bytes, size_t align = 16) {
+		size_t offset = (used + align - 1) & ~(align - 1);
+		if (blocks.empty() || offset + bytes > blocks.back().size) {
+			// Blocks double from ARENA_MIN_BLOCK up to ARENA_BLOCK, so small meshes stay small.
+			// Oversized requests get a block of their own.
+			size_t size = reserved < ARENA_MIN_BLOCK ? ARENA_MIN_BLOCK : reserved;
+			if (size > ARENA_BLOCK) size = ARENA_BLOCK;
+			if (bytes + align > size) size = bytes + align;
+			char* data = (char*)malloc(size);
+			if (!data) throw std::bad_alloc();
+			blocks.push_back(Block{ data, size });
+			reserved += size;
+			offset = (-(uintptr_t)data) & (align - 1);
+		}
+		last = blocks.back().data + offset;
+		used = offset + bytes;
+		return last;
+	}
+
+	// Only the most recent allocation can be given back
+	void release(void* ptr) {
+		if (ptr == last) used = (char*)ptr - blocks.back().data;
+	}
+
+	void clear() {
+		for (Block& block : blocks)
+			free(block.data);
+		blocks.clear();
+		reserved = used = 0;
+		last = nullptr;
+	}
+
+	// Bytes obtained from the system
+	size_t bytesReserved() const { return reserved; }
+
+private:
+	struct Block {
+		char* data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t reserved = 0;
+	size_t used = 0; // In the current block
+	void* last = nullptr;
+};
+
+// Standard allocator on top of an Arena. Without an arena it falls back to
+// the heap, so the same container types work inside and outside meshes.
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(Arena* arena = nullptr): arena(arena) {}
+	template<typename U> ArenaAllocator(const ArenaAllocator<U>& other): arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		if (!arena) return (T*)::operator new(n * sizeof(T));
+		return (T*)arena->allocate(n * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	void deallocate(T* ptr, size_t) {
+		if (!arena) ::operator delete(ptr);
+		else arena->release(ptr);
+	}
+
+	template<typename U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template<typename U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+	Arena* arena;
+};
+
+template<typename T> using Array = std::vector<T, ArenaAllocator<T>>;
@@ -9,8 +9,18 @@ class Args {
 public:
 	Args(int argc, char* argv[]): app_name(argv[0])
 	{
-		for (int i = 1; i < argc; ++i) {
-			std::string arg(argv[i]);
+		parse(std::vector<std::string>(argv + 1, argv + argc));
+	}
+
+	Args(const std::vector<std::string>& params, const std::string& app = ""): app_name(app)
+	{
+		parse(params);
+	}
+
+private:
+	void parse(const std::vector<std::string>& params) {
+		for (size_t i = 0; i < params.size(); ++i) {
+			std::string arg(params[i]);
 			int l = arg.length();
 			if (l == 0) continue;
 			if (arg[0] == '-' && l >= 2) {
@@ -42,6 +52,7 @@ public:
 		}
 	}
 
+public:
 	bool opt(char shortopt, std::string longopt) {
 		if (shortopt && shortopt != ' ' && shortopts.count(shortopt)) return true;
 		if (!longopt.empty() && longopts.count(longopt)) return true;
@@ -64,6 +75,18 @@ public:
 		return default_arg;
 	}
 
+	// Values of an option that can be given several times, in order
+	std::vector<std::string> all(char shortopt, std::string longopt) {
+		std::vector<std::string> values;
+		for (std::vector<std::string>::const_iterator it = allopts.begin(); it != allopts.end(); ++it) {
+			if (*it == "-" + std::string(1, shortopt) || *it == "--" + longopt) {
+				if (it + 1 == allopts.end() || (*(it + 1))[0] == '-') continue;
+				values.push_back(*++it);
+			}
+		}
+		return values;
+	}
+
 	const std::vector<std::string>& orphans() const { return globalopts; }
 
 	std::string app() const { return app_name; }
@@ -78,7 +101,7 @@ private:
 
 
 template<>
-std::string Args::arg<std::string>(char shortopt, std::string longopt, std::string default_arg) {
+inline std::string Args::arg<std::string>(char shortopt, std::string longopt, std::string default_arg) {
 	for (std::vector<std::string>::const_iterator it = allopts.begin(); it != allopts.end(); ++it) {
 		if (*it == "-" + std::string(1, shortopt) || *it == "--" + longopt) {
 			++it;
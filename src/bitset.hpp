@@ -0,0 +1,50 @@
+#pragma once
+
+// Compact set of flags, one bit per element
+
+#include <cstdint>
+
+#include "arena.hpp"
+
+class Bitset {
+public:
+	explicit Bitset(Arena* arena = nullptr): words(ArenaAllocator<uint64_t>(arena)) {}
+
+	// New bits start cleared
+	void resize(size_t count) {
+		words.resize((count + 63) / 64);
+		if (count < bits && count % 64) words.back() &= (1ull << (count % 64)) - 1;
+		bits = count;
+	}
+	size_t size() const { return bits; }
+
+	bool test(size_t i) const { return words[i >> 6] >> (i & 63) & 1; }
+	void set(size_t i) { words[i >> 6] |= 1ull << (i & 63); }
+	void reset(size_t i) { words[i >> 6] &= ~(1ull << (i & 63)); }
+	void clear() { for (uint64_t& word : words) word = 0; }
+	// Sets the bits that are clear in other, which has the same size
+	void setUnset(const Bitset& other) {
+		for (size_t i = 0; i < words.size(); ++i)
+			words[i] |= ~other.words[i];
+		if (bits % 64) words.back() &= (1ull << (bits % 64)) - 1;
+	}
+	bool any() const {
+		for (uint64_t word : words)
+			if (word) return true;
+		return false;
+	}
+
+	size_t count() const {
+		size_t total = 0;
+		for (uint64_t word : words)
+			total += __builtin_popcountll(word);
+		return total;
+	}
+
+	size_t bytes() const { return words.capacity() * sizeof(uint64_t); }
+	const uint64_t* data() const { return words.data(); }
+
+private:
+	Array<uint64_t> words;
+	size_t bits = 0;
+};
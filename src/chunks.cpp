@@ -0,0 +1,284 @@
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+
+#include "chunks.hpp"
+#include "vertexcache.hpp"
+#include "vertexfetch.hpp"
+#include "vecmath.hpp"
+
+namespace objmagic {
+
+namespace {
+
+// Name given by a g or o record (empty if none), with blanks replaced by '_'
+std::string recordName(const Text& record) {
+	std::string name = record.size > 2 ? std::string(record.data + 2, record.size - 2) : "";
+	size_t end = name.find_last_not_of(" \t\r");
+	name.resize(end == std::string::npos ? 0 : end + 1);
+	name.erase(0, std::min(name.find_first_not_of(" \t"), name.size()));
+	std::replace(name.begin(), name.end(), ' ', '_');
+	std::replace(name.begin(), name.end(), '\t', '_');
+	return name;
+}
+
+// Group name for the chunks of a run under the g and o records (empty if none). Runs outside
+// any group are named after their object, so that chunks of different objects stay apart.
+std::string chunkBaseName(const Text& group, const Text& object) {
+	std::string name = recordName(group);
+	if (name.empty()) name = recordName(object);
+	return name.empty() ? "chunk" : name;
+}
+
+// Assigns the faces of a run to chunks of at most maxVertices render vertices, filling them in
+// Z-order. Writes the faces to order chunk by chunk and returns the number of chunks.
+size_t partitionRun(const Mesh& mesh, const RenderVertices& vertices, const Range& run, size_t maxVertices,
+	std::vector<uint64_t>& stamp, uint64_t& tag, Index* order, std::vector<Index>& chunkSizes)
+{
+	const Elements& faces = mesh.faces;
+	std::vector<glm::vec3> centroids(run.count);
+	glm::vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+	for (Index i = 0; i < run.count; ++i) {
+		Index f = run.first + i;
+		glm::vec3 sum(0.0f);
+		for (Index c = faces.offsets[f]; c < faces.offsets[f + 1]; ++c)
+			sum += glm::vec3(mesh.px[faces.v[c]], mesh.py[faces.v[c]], mesh.pz[faces.v[c]]);
+		centroids[i] = sum / float(std::max<Index>(faces.corners(f), 1));
+		lower = glm::min(lower, centroids[i]);
+		upper = glm::max(upper, centroids[i]);
+	}
+	glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-30f));
+	std::vector<std::pair<uint32_t, Index>> keys(run.count);
+	for (Index i = 0; i < run.count; ++i)
+		keys[i] = std::make_pair(mortonCode((centroids[i] - lower) / extent), i);
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> chunkOf(run.count);
+	std::vector<Index> fresh;
+	size_t chunks = 0, used = 0;
+	for (const auto& key : keys) {
+		Index f = run.first + key.second;
+		fresh.clear();
+		for (Index c = faces.offsets[f]; c < faces.offsets[f + 1]; ++c) {
+			Index r = vertices.corners[c];
+			if (stamp[r] != tag && std::find(fresh.begin(), fresh.end(), r) == fresh.end())
+				fresh.push_back(r);
+		}
+		if (chunks == 0 || (used > 0 && used + fresh.size() > maxVertices)) {
+			++chunks;
+			++tag;
+			used = 0;
+			fresh.clear();
+			for (Index c = faces.offsets[f]; c < faces.offsets[f + 1]; ++c) {
+				Index r = vertices.corners[c];
+				if (std::find(fresh.begin(), fresh.end(), r) == fresh.end()) fresh.push_back(r);
+			}
+		}
+		for (Index r : fresh) stamp[r] = tag;
+		used += fresh.size();
+		chunkOf[key.second] = chunks - 1;
+	}
+
+	// Chunk by chunk, faces in their original order
+	std::vector<Index> start(chunks + 1, 0);
+	for (uint32_t c : chunkOf) ++start[c + 1];
+	for (size_t c = 0; c < chunks; ++c) {
+		chunkSizes.push_back(start[c + 1]);
+		start[c + 1] += start[c];
+	}
+	for (Index i = 0; i < run.count; ++i)
+		order[start[chunkOf[i]]++] = run.first + i;
+	return chunks;
+}
+
+// Renumbers vertices, texture coordinates and normals so that their records appear in index
+// order again, after some were inserted among the others
+void renumberByRecords(Mesh& mesh) {
+	const RecordKind kinds[3] = { RecordVertex, RecordTexCoord, RecordNormal };
+	Array<float>* const arrays[3][3] = {
+		{ &mesh.px, &mesh.py, &mesh.pz }, { &mesh.tu, &mesh.tv, nullptr }, { &mesh.nx, &mesh.ny, &mesh.nz }
+	};
+	Bitset* const dirty[3] = { &mesh.vertexDirty, &mesh.texCoordDirty, &mesh.normalDirty };
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	for (int k = 0; k < 3; ++k) {
+		std::vector<Index> order; // Old index of each new one
+		order.reserve(arrays[k][0]->size());
+		for (Record& record : mesh.records) {
+			if (record.kind != kinds[k]) continue;
+			order.push_back(record.index);
+			record.index = order.size() - 1;
+		}
+		std::vector<Index> newIndex(order.size());
+		bool moved = false;
+		for (size_t i = 0; i < order.size(); ++i) {
+			newIndex[order[i]] = i;
+			moved |= order[i] != i;
+		}
+		if (!moved) continue;
+		std::vector<float> tmp(order.size());
+		for (Array<float>* array : arrays[k]) {
+			if (!array) continue;
+			for (size_t i = 0; i < order.size(); ++i) tmp[i] = (*array)[order[i]];
+			std::copy(tmp.begin(), tmp.end(), array->begin());
+		}
+		Bitset was = *dirty[k];
+		for (size_t i = 0; i < order.size(); ++i) {
+			if (was.test(order[i])) dirty[k]->set(i);
+			else dirty[k]->reset(i);
+		}
+		for (Elements* list : lists) {
+			Array<Index>& corners = k == 0 ? list->v : k == 1 ? list->vt : list->vn;
+			for (size_t i = 0; i < list->size(); ++i) {
+				for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+					Index& index = corners[c];
+					if (index == NoIndex || newIndex[index] == index) continue;
+					index = newIndex[index];
+					list->dirty.set(i);
+				}
+			}
+		}
+	}
+}
+
+} // namespace
+
+void limitVertices(Mesh& mesh, size_t maxVertices, Report* report) {
+	RenderVertices vertices(mesh);
+	Array<Range> runs = mesh.faceRuns();
+	Array<Index> order;
+	order.resize(mesh.faces.size());
+	for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+	// Chunks as consecutive face counts, in face order, and whether they split a run
+	std::vector<Index> chunkSizes;
+	std::vector<int> chunkPart; // Position within its run, -1 if the run is not split
+	std::vector<uint64_t> stamp(vertices.count, 0);
+	uint64_t tag = 0;
+	size_t splitRuns = 0;
+	for (const Range& run : runs) {
+		++tag;
+		size_t distinct = 0;
+		for (Index c = mesh.faces.offsets[run.first]; c < mesh.faces.offsets[run.first + run.count]; ++c) {
+			Index r = vertices.corners[c];
+			if (stamp[r] != tag) {
+				stamp[r] = tag;
+				++distinct;
+			}
+		}
+		if (distinct <= maxVertices) {
+			chunkSizes.push_back(run.count);
+			chunkPart.push_back(-1);
+			continue;
+		}
+		size_t chunks = partitionRun(mesh, vertices, run, maxVertices, stamp, tag, &order[run.first], chunkSizes);
+		for (size_t c = 0; c < chunks; ++c)
+			chunkPart.push_back(c);
+		++splitRuns;
+	}
+	if (splitRuns) mesh.permuteFaces(order);
+
+	// Chunks get their own copies of shared attributes
+	Elements& faces = mesh.faces;
+	Array<Index>* const corners[3] = { &faces.v, &faces.vt, &faces.vn };
+	const size_t counts[3] = { mesh.vertexCount(), mesh.texCoordCount(), mesh.normalCount() };
+	std::vector<Index> copies[3]; // Original of each copy
+	std::vector<uint32_t> owner[3];
+	std::unordered_map<Index, Index> local[3];
+	for (int k = 0; k < 3; ++k) owner[k].assign(counts[k], ~0u);
+	std::vector<size_t> chunkCopies[3]; // First copy of each chunk, and the total at the end
+	Index face = 0;
+	for (size_t chunk = 0; chunk < chunkSizes.size(); ++chunk) {
+		for (int k = 0; k < 3; ++k) {
+			local[k].clear();
+			chunkCopies[k].push_back(copies[k].size());
+		}
+		for (Index end = face + chunkSizes[chunk]; face < end; ++face) {
+			for (Index c = faces.offsets[face]; c < faces.offsets[face + 1]; ++c) {
+				for (int k = 0; k < 3; ++k) {
+					Index& index = (*corners[k])[c];
+					if (index == NoIndex) continue;
+					if (owner[k][index] == ~0u) owner[k][index] = chunk;
+					if (owner[k][index] == chunk) continue;
+					auto it = local[k].find(index);
+					if (it == local[k].end()) {
+						it = local[k].emplace(index, counts[k] + copies[k].size()).first;
+						copies[k].push_back(index);
+					}
+					index = it->second;
+					faces.dirty.set(face);
+				}
+			}
+		}
+	}
+	for (int k = 0; k < 3; ++k) chunkCopies[k].push_back(copies[k].size());
+	Array<float>* const arrays[3][3] = {
+		{ &mesh.px, &mesh.py, &mesh.pz }, { &mesh.tu, &mesh.tv, nullptr }, { &mesh.nx, &mesh.ny, &mesh.nz }
+	};
+	Bitset* const dirty[3] = { &mesh.vertexDirty, &mesh.texCoordDirty, &mesh.normalDirty };
+	size_t copied = 0;
+	for (int k = 0; k < 3; ++k) {
+		copied += copies[k].size();
+		if (copies[k].empty()) continue;
+		for (Array<float>* array : arrays[k]) {
+			if (!array) continue;
+			array->resize(counts[k] + copies[k].size());
+			for (size_t i = 0; i < copies[k].size(); ++i)
+				(*array)[counts[k] + i] = (*array)[copies[k][i]];
+		}
+		dirty[k]->resize(counts[k] + copies[k].size());
+		for (size_t i = 0; i < copies[k].size(); ++i)
+			if (dirty[k]->test(copies[k][i])) dirty[k]->set(counts[k] + i);
+	}
+
+	// Copies go right before the chunk using them, so that faces only refer back to records
+	// before them when there are several blocks of v records. Each chunk of a split run gets
+	// a group record before it, and the run's own group is restored after it.
+	if (splitRuns || copied) {
+		const RecordKind kinds[3] = { RecordVertex, RecordTexCoord, RecordNormal };
+		Array<Record> records(ArenaAllocator<Record>(&mesh.arena));
+		records.reserve(mesh.records.size() + copied + (splitRuns ? chunkSizes.size() + splitRuns : 0));
+		Text group = { "", 0 }, object = { "", 0 };
+		Index restore = NoIndex; // Group record to add after the current run
+		size_t chunk = 0;
+		Index chunkEnd = 0; // Face after the current chunk
+		for (const Record& record : mesh.records) {
+			if (record.kind != RecordFace && restore != NoIndex) {
+				records.push_back(Record{ NoLine, restore, RecordGroup });
+				restore = NoIndex;
+			}
+			if (record.kind == RecordGroup) group = mesh.texts[record.index];
+			if (record.kind == RecordObject) object = mesh.texts[record.index];
+			if (record.kind == RecordFace && record.index == chunkEnd && chunk < chunkSizes.size()) {
+				for (int k = 0; k < 3; ++k)
+					for (size_t i = chunkCopies[k][chunk]; i < chunkCopies[k][chunk + 1]; ++i)
+						records.push_back(Record{ NoLine, (Index)(counts[k] + i), kinds[k] });
+				if (chunkPart[chunk] >= 0) {
+					std::string name = "g " + chunkBaseName(group, object) + "_" + std::to_string(chunkPart[chunk]);
+					records.push_back(Record{ NoLine, mesh.addText(name), RecordGroup });
+					if (chunkPart[chunk] == 0)
+						restore = group.size ? mesh.addText(group.str()) : mesh.addText("g default");
+				}
+				chunkEnd += chunkSizes[chunk++];
+			}
+			records.push_back(record);
+		}
+		std::swap(mesh.records, records);
+		if (splitRuns) mesh.updateRanges();
+		if (copied) {
+			renumberByRecords(mesh);
+			mesh.renumbered = true;
+		}
+	}
+	optimizeVertexFetch(mesh, nullptr);
+
+	if (report) {
+		report->add("Chunks", chunkSizes.size());
+		report->add("Split runs", splitRuns);
+		report->add("Copied v", copies[0].size());
+		report->add("Copied vt", copies[1].size());
+		report->add("Copied vn", copies[2].size());
+	}
+}
+
+} // namespace objmagic
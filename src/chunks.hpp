@@ -0,0 +1,21 @@
+#pragma once
+
+// Splitting of faces into chunks with few enough vertices for 16-bit index buffers
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Splits every run of faces (see Mesh::faceRuns) that uses more than maxVertices distinct
+// (v, vt, vn) tuples into chunks of at most that many. Chunks are filled with faces in Z-order
+// of their centroids so that they are spatially coherent, faces keep their relative order
+// within a chunk, and a face with more corners than maxVertices gets a chunk of its own.
+// Each chunk of a split run is put in its own group, named after the run's group (or its
+// object, outside any group) with _0, _1, ... appended. Then every chunk, split or not, gets
+// its own copies of the vertices, texture coordinates and normals it shares with others,
+// written right before it, and all of them are renumbered in order of first use, so that each
+// chunk refers to a contiguous range of each of them.
+void limitVertices(Mesh& mesh, size_t maxVertices, Report* report);
+
+} // namespace objmagic
@@ -0,0 +1,205 @@
+#include <vector>
+
+#include "clean.hpp"
+
+namespace objmagic {
+
+namespace {
+
+inline bool isElement(const char* row, size_t len) {
+	return len >= 2 && row[1] == ' ' && (row[0] == 'f' || row[0] == 'l' || row[0] == 'p');
+}
+
+inline void mark(Bitset& bits, uint64_t i) {
+	if (i >= bits.size()) bits.resize(i + 1);
+	bits.set(i);
+}
+
+void appendNumber(std::string& out, uint64_t value, bool negative) {
+	char tmp[24];
+	char* p = tmp + sizeof(tmp);
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	if (negative) *--p = '-';
+	out.append(p, tmp + sizeof(tmp) - p);
+}
+
+// Compacts the kept attribute values towards the front, dirty flags included
+template<typename T>
+void compact(const Remap& remap, Bitset& dirty, Array<T>& a, Array<T>& b, Array<T>* c) {
+	uint64_t k = 0;
+	for (uint64_t i = 0; i < remap.size(); ++i) {
+		if (!remap.kept(i)) continue;
+		a[k] = a[i];
+		b[k] = b[i];
+		if (c) (*c)[k] = (*c)[i];
+		if (dirty.test(i)) dirty.set(k);
+		else dirty.reset(k);
+		++k;
+	}
+	a.resize(k);
+	b.resize(k);
+	if (c) c->resize(k);
+	dirty.resize(k);
+}
+
+} // namespace
+
+bool markReferences(Source& source, References& refs, std::string& error, ElementFilter* filter, References* deleted) {
+	ElementCounts sofar;
+	std::vector<uint64_t> tuples(3 * 64);
+	uint64_t line = 0;
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		++line;
+		if (len < 2) continue;
+		if (row[0] == 'v') {
+			if (row[1] == ' ') ++sofar.v;
+			else if (row[1] == 't' && len >= 3 && row[2] == ' ') ++sofar.vt;
+			else if (row[1] == 'n' && len >= 3 && row[2] == ' ') ++sofar.vn;
+			continue;
+		}
+		if (!isElement(row, len)) {
+			if (filter) filter->update(row, len);
+			continue;
+		}
+		References& marked = filter && filter->deleting() ? *deleted : refs;
+		int n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+		if (n > (int)tuples.size() / 3) {
+			tuples.resize(3 * n);
+			n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], n);
+		}
+		if (n < 0) {
+			error = "Malformed element in " + source.name() + " line " + std::to_string(line);
+			return false;
+		}
+		for (int i = 0; i < n; ++i) {
+			mark(marked.v, tuples[i * 3]);
+			if (tuples[i * 3 + 1] != noIndex<uint64_t>()) mark(marked.vt, tuples[i * 3 + 1]);
+			if (tuples[i * 3 + 2] != noIndex<uint64_t>()) mark(marked.vn, tuples[i * 3 + 2]);
+		}
+	}
+	source.rewind();
+	if (filter) filter->rewind();
+	References* const lists[] = { &refs, deleted };
+	for (References* list : lists) {
+		if (!list) continue;
+		if (list->v.size() > sofar.v || list->vt.size() > sofar.vt || list->vn.size() > sofar.vn) {
+			error = "Index out of range in " + source.name();
+			return false;
+		}
+		list->v.resize(sofar.v);
+		list->vt.resize(sofar.vt);
+		list->vn.resize(sofar.vn);
+		list->counts = sofar;
+	}
+	return true;
+}
+
+bool remapIndices(const char* row, size_t len, const ElementCounts& sofar, const ElementCounts& keptSofar,
+	const Remap* const remaps[3], std::string& out)
+{
+	const uint64_t counts[3] = { sofar.v, sofar.vt, sofar.vn };
+	const uint64_t keptCounts[3] = { keptSofar.v, keptSofar.vt, keptSofar.vn };
+	const char* p = row + 2;
+	const char* end = row + len;
+	out.assign(row, 2);
+	int slot = 0;
+	while (p < end) {
+		char c = *p;
+		if (c == '#') break;
+		if (c == '/' || c == ' ' || c == '\t') {
+			slot = c == '/' ? slot + 1 : 0;
+			out += c;
+			++p;
+			continue;
+		}
+		bool negative = c == '-';
+		if (negative) ++p;
+		if (slot > 2 || p >= end || !detail::isDigit(*p)) return false;
+		uint64_t value = 0;
+		for (; p < end && detail::isDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+		if (value == 0 || value > (negative ? counts[slot] : remaps[slot]->size())) return false;
+		uint64_t index = negative ? counts[slot] - value : value - 1;
+		uint64_t renumbered = (*remaps[slot])(index);
+		appendNumber(out, negative ? keptCounts[slot] - renumbered : renumbered + 1, negative);
+	}
+	out.append(p, end - p);
+	return true;
+}
+
+void removeUnreferenced(Mesh& mesh, Report* report) {
+	Bitset used[3];
+	used[0].resize(mesh.vertexCount());
+	used[1].resize(mesh.texCoordCount());
+	used[2].resize(mesh.normalCount());
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	for (Elements* list : lists) {
+		for (size_t c = 0; c < list->v.size(); ++c) {
+			used[0].set(list->v[c]);
+			if (list->vt[c] != NoIndex) used[1].set(list->vt[c]);
+			if (list->vn[c] != NoIndex) used[2].set(list->vn[c]);
+		}
+	}
+	Remap v(used[0]), vt(used[1]), vn(used[2]);
+	if (report) reportRemoved(*report, v, vt, vn);
+	removeElements(mesh, v, vt, vn);
+}
+
+void removeElements(Mesh& mesh, const Remap& v, const Remap& vt, const Remap& vn) {
+	if (!v.removedCount() && !vt.removedCount() && !vn.removedCount())
+		return;
+
+	compact(v, mesh.vertexDirty, mesh.px, mesh.py, &mesh.pz);
+	compact(vt, mesh.texCoordDirty, mesh.tu, mesh.tv, (Array<float>*)nullptr);
+	compact(vn, mesh.normalDirty, mesh.nx, mesh.ny, &mesh.nz);
+
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	for (Elements* list : lists) {
+		for (size_t i = 0; i < list->size(); ++i) {
+			bool changed = false;
+			for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+				Index old = list->v[c];
+				list->v[c] = v(old);
+				changed |= list->v[c] != old;
+				if (list->vt[c] != NoIndex) {
+					old = list->vt[c];
+					list->vt[c] = vt(old);
+					changed |= list->vt[c] != old;
+				}
+				if (list->vn[c] != NoIndex) {
+					old = list->vn[c];
+					list->vn[c] = vn(old);
+					changed |= list->vn[c] != old;
+				}
+			}
+			if (changed) list->dirty.set(i);
+		}
+	}
+
+	size_t k = 0;
+	for (size_t i = 0; i < mesh.records.size(); ++i) {
+		Record record = mesh.records[i];
+		const Remap* remap = record.kind == RecordVertex ? &v : record.kind == RecordTexCoord ? &vt
+			: record.kind == RecordNormal ? &vn : nullptr;
+		if (remap) {
+			if (!remap->kept(record.index)) continue;
+			record.index = (*remap)(record.index);
+		}
+		mesh.records[k++] = record;
+	}
+	mesh.records.resize(k);
+	mesh.renumbered = true;
+}
+
+void reportRemoved(Report& report, const Remap& v, const Remap& vt, const Remap& vn) {
+	report.add("Removed v", v.removedCount());
+	report.add("Removed vt", vt.removedCount());
+	report.add("Removed vn", vn.removedCount());
+}
+
+} // namespace objmagic
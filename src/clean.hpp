@@ -0,0 +1,42 @@
+#pragma once
+
+// Removal of vertices, texture coordinates and normals no element refers to
+
+#include <string>
+
+#include "objmagic.hpp"
+#include "parse.hpp"
+#include "remap.hpp"
+#include "mesh.hpp"
+#include "filter.hpp"
+
+namespace objmagic {
+
+// Elements referred to by f, l and p records
+struct References {
+	Bitset v, vt, vn;
+	ElementCounts counts; // Elements in the whole source
+};
+
+// Streams the source once, marking referenced elements. Rewinds the source when done.
+// With a filter, the elements it deletes mark their references in deleted instead.
+bool markReferences(Source& source, References& refs, std::string& error,
+	ElementFilter* filter = nullptr, References* deleted = nullptr);
+
+// Writes the f, l or p record row to out with indices renumbered by the remaps (v, vt, vn).
+// sofar and keptSofar are the element counts before the record in the old and new numbering,
+// so relative indices stay relative. Spacing, slashes and comments are kept as they are.
+// Returns false if an index is malformed or refers to nothing.
+bool remapIndices(const char* row, size_t len, const ElementCounts& sofar, const ElementCounts& keptSofar,
+	const Remap* const remaps[3], std::string& out);
+
+// Removes unreferenced elements from the mesh, marking the elements it renumbers dirty
+void removeUnreferenced(Mesh& mesh, Report* report);
+
+// Removes the elements the remaps don't keep from the mesh. Elements must not refer to them.
+void removeElements(Mesh& mesh, const Remap& v, const Remap& vt, const Remap& vn);
+
+// Adds the removed counts to the report
+void reportRemoved(Report& report, const Remap& v, const Remap& vt, const Remap& vn);
+
+} // namespace objmagic
@@ -0,0 +1,340 @@
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <memory>
+
+#include <sys/stat.h>
+
+#include "command.hpp"
+#include "threadpool.hpp"
+#include "args.hpp"
+#include "split.hpp"
+#include "merge.hpp"
+#include "mesh.hpp"
+#include "meshlets.hpp"
+#include "vertexcache.hpp"
+#include "redundant.hpp"
+
+namespace objmagic {
+
+namespace {
+
+// Parameters naming .obj files, except values given to options taking names
+std::vector<std::string> inputFiles(const std::vector<std::string>& params) {
+	std::vector<std::string> files;
+	for (size_t i = 0; i < params.size(); ++i) {
+		const std::string& param = params[i];
+		if (param == "-o" || param == "--out" || param == "--delete-material" || param == "--delete-group"
+			|| param == "--delete-object" || param == "--meshlets") ++i;
+		else if (!param.empty() && param[0] != '-' && param.find(".obj") != std::string::npos)
+			files.push_back(param);
+	}
+	return files;
+}
+
+// File name without directory and .obj extension
+std::string stem(const std::string& path) {
+	std::string name = path.substr(path.find_last_of('/') + 1);
+	if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+		name.resize(name.size() - 4);
+	return name;
+}
+
+// Splits the source into files named after base (without .obj), after running the other
+// operations on it through a temp file if there are any. Levels of detail for --lod-files
+// are objects of their own, which the source is split by.
+bool splitSource(Source& source, std::string base, const Options& options, std::string& error, Report& report) {
+	if (base.size() > 4 && base.compare(base.size() - 4, 4, ".obj") == 0)
+		base.resize(base.size() - 4);
+	Options rest = options;
+	rest.splitBy = SplitNone;
+	rest.lodName.clear();
+	Source processed;
+	bool transformed = rest.changesMesh() || rest.optimizeMaterials;
+	if (transformed && !processToTemp(source, processed, rest, error, nullptr, &report))
+		return false;
+	SplitMode mode = options.lodFiles ? SplitObject : options.splitBy;
+	return splitBy(transformed ? processed : source, base, mode, options.bufferSize, error, &report);
+}
+
+// For --info with operations that look at the whole mesh: loads the source, returns the info
+// of the analyzing pass from the loaded mesh, so the model is read only once, and adds the
+// cache stats of its faces and the summary of its meshlets to the report
+bool analyzeMesh(Source& source, const Options& options, Info& info, std::string& error, Report& report) {
+	Mesh mesh;
+	if (!mesh.load(source, error))
+		return false;
+	info = mesh.analyze();
+	if (options.optimizeVertexCache)
+		reportCacheStats(mesh, report);
+	return options.meshletFile.empty() || exportMeshlets(mesh, options.meshletFile, *options.pool, error, &report);
+}
+
+} // namespace
+
+
+Info AnalysisCache::analyze(Source& source) {
+	struct stat st;
+	if (stat(source.name().c_str(), &st) != 0)
+		return objmagic::analyze(source);
+	int64_t mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(source.name());
+		if (it != entries.end()) {
+			if (it->second.size == (uint64_t)st.st_size && it->second.mtime == mtime) {
+				lru.splice(lru.begin(), lru, it->second.lru);
+				return it->second.info;
+			}
+			lru.erase(it->second.lru);
+			entries.erase(it);
+		}
+	}
+	Info info = objmagic::analyze(source);
+	std::lock_guard<std::mutex> lock(mutex);
+	if (entries.count(source.name())) return info; // Another thread got there first
+	lru.push_front(source.name());
+	entries[source.name()] = Entry{ (uint64_t)st.st_size, mtime, info, lru.begin() };
+	if (entries.size() > capacity) {
+		entries.erase(lru.back());
+		lru.pop_back();
+	}
+	return info;
+}
+
+int runCommand(const std::vector<std::string>& params, std::ostream& defaultOut, std::ostream& err, Workspace& workspace) {
+	Args args(params);
+	Options options;
+	std::string error;
+	if (!options.parse(params, error)) {
+		err << error << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool info = options.info;
+	// Batch modes share their pool, a single invocation starts its own
+	std::unique_ptr<ThreadPool> ownPool(workspace.pool ? nullptr : new ThreadPool);
+	options.pool = workspace.pool ? workspace.pool : ownPool.get();
+
+	// Output stream handling
+	std::vector<std::string> files = inputFiles(params);
+	if (files.empty()) {
+		err << "Need at least one input file!" << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto resolve = [&workspace](const std::string& path) {
+		if (workspace.directory.empty() || path.empty() || path[0] == '/') return path;
+		return workspace.directory + "/" + path;
+	};
+	options.meshletFile = resolve(options.meshletFile);
+
+	std::string outfile = args.arg<std::string>('o', "out");
+	std::ofstream fout;
+	bool inPlaceOutput = false;
+	bool split = options.splitBy != SplitNone || options.lodFiles;
+	bool merge = options.merge && !info;
+	if (merge && std::find(files.begin(), files.end(), outfile) != files.end()) {
+		err << "Can't merge into one of the input files." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (files.size() > 1 && !merge) {
+		inPlaceOutput = !info && !split;
+		if (!outfile.empty()) {
+			err << "Can't use -o / --out option with multiple input files." << std::endl;
+			return EXIT_FAILURE;
+		}
+	} else if (split) {
+		// Outputs are named after -o / --out or the input
+	} else if (!merge && (outfile == files[0] || args.opt('O', "overwrite"))) { // In-place
+		inPlaceOutput = true;
+	} else if (!outfile.empty()) {
+		fout.open(resolve(outfile).c_str());
+		if (fout.fail()) {
+			err << "Failed to open file " << outfile << " for output" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (merge) {
+		std::vector<std::string> paths;
+		for (const std::string& infile : files)
+			paths.push_back(resolve(infile));
+		Options rest = options;
+		rest.merge = false;
+		rest.lodName = stem(outfile.empty() ? "merged.obj" : outfile);
+		Report report;
+		auto mergeAll = [&](Sink& sink) {
+			return mergeFiles(paths, sink, options.prefixNames, options.bufferSize, error, &report);
+		};
+		Sink sink(outfile.empty() ? defaultOut : fout);
+		bool ok;
+		if (!split && !rest.changesMesh() && !rest.optimizeMaterials) {
+			ok = mergeAll(sink);
+		} else {
+			// The other operations work on the merged model
+			Source merged;
+			ok = writeToTemp(mergeAll, merged, error) && (split
+				? splitSource(merged, resolve(outfile.empty() ? "merged.obj" : outfile), rest, error, report)
+				: process(merged, sink, rest, error, nullptr, &report));
+		}
+		if (!ok) {
+			err << error << std::endl;
+			return EXIT_FAILURE;
+		}
+		writeReport(err, report);
+		return EXIT_SUCCESS;
+	}
+
+	bool infoHeaderDone = false;
+	for (const std::string& infile : files) {
+		std::stringstream sout;
+		std::ostream& out = inPlaceOutput ? sout : (outfile.empty() ? defaultOut : fout);
+
+		options.lodName = stem(infile);
+		Source& source = workspace.source;
+		if (!source.open(resolve(infile), error)) {
+			err << error << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		// Output info?
+		if (info) {
+			if (!infoHeaderDone) {
+				out << OBJMAGIC_APPNAME << " " << OBJMAGIC_VERSION << std::endl;
+				infoHeaderDone = true;
+			} else out << std::endl;
+			out << std::endl;
+			// Statistics of the operations that report without changing anything follow the info
+			Info analyzed;
+			Report report;
+			bool ok = true;
+			if (options.meshletFile.empty() && !options.optimizeVertexCache)
+				analyzed = workspace.cache ? workspace.cache->analyze(source) : analyze(source);
+			else ok = analyzeMesh(source, options, analyzed, error, report);
+			// Faces that would be removed are counted
+			ok = ok && (!options.removesFaces() || removeRedundantFaces(source, nullptr, options, error, &report));
+			source.close();
+			if (!ok) {
+				err << error << std::endl;
+				return EXIT_FAILURE;
+			}
+			writeInfo(out, infile, analyzed);
+			writeReport(out, report);
+			continue;
+		}
+
+		if (split) {
+			Report report;
+			bool ok = splitSource(source, resolve(outfile.empty() ? infile : outfile), options, error, report);
+			source.close();
+			if (!ok) {
+				err << error << std::endl;
+				return EXIT_FAILURE;
+			}
+			writeReport(err, report);
+			continue;
+		}
+
+		Sink sink(out);
+		Info cached;
+		if (workspace.cache && options.needsAnalysis())
+			cached = workspace.cache->analyze(source);
+		Report report;
+		bool ok = process(source, sink, options, error, workspace.cache ? &cached : nullptr, &report);
+		source.close();
+		if (!ok) {
+			err << error << std::endl;
+			return EXIT_FAILURE;
+		}
+		// Statistics go to the error stream to keep them out of the mesh output
+		writeReport(err, report);
+
+		if (inPlaceOutput) {
+			std::ofstream finplaceout;
+			finplaceout.open(resolve(infile).c_str());
+			if (finplaceout.fail()) {
+				err << "Failed to open file " << infile << " for output" << std::endl;
+				return EXIT_FAILURE;
+			}
+			finplaceout << sout.rdbuf();
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+std::vector<std::string> splitCommandLine(const std::string& line) {
+	std::vector<std::string> params;
+	std::string current;
+	bool inParam = false;
+	char quote = 0;
+	for (size_t i = 0; i < line.size(); ++i) {
+		char c = line[i];
+		if (c == '\\' && i + 1 < line.size() && quote != '\'') {
+			current += line[++i];
+			inParam = true;
+		} else if (quote) {
+			if (c == quote) quote = 0;
+			else current += c;
+		} else if (c == '"' || c == '\'') {
+			quote = c;
+			inParam = true;
+		} else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			if (inParam) params.push_back(current);
+			current.clear();
+			inParam = false;
+		} else {
+			current += c;
+			inParam = true;
+		}
+	}
+	if (inParam) params.push_back(current);
+	return params;
+}
+
+int runJobs(std::istream& jobs, std::ostream& status, unsigned threads) {
+	ThreadPool pool(threads);
+	std::vector<Workspace> workspaces(pool.size());
+	for (Workspace& workspace : workspaces)
+		workspace.pool = &pool;
+	std::mutex statusMutex;
+	bool failed = false;
+
+	std::string line;
+	unsigned lineNumber = 0;
+	while (getline(jobs, line)) {
+		++lineNumber;
+		std::vector<std::string> params = splitCommandLine(line);
+		if (params.empty() || params[0][0] == '#') continue;
+		pool.enqueue([&, params, lineNumber](unsigned worker) {
+			auto start = std::chrono::steady_clock::now();
+			std::ostringstream out, err;
+			int ret = runCommand(params, out, err, workspaces[worker]);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::string message = err.str();
+			if (ret == EXIT_SUCCESS) {
+				message.clear();
+				for (const std::string& file : inputFiles(params))
+					message += (message.empty() ? "" : " ") + file;
+			}
+			std::replace(message.begin(), message.end(), '\n', ' ');
+			while (!message.empty() && message.back() == ' ') message.pop_back();
+
+			std::lock_guard<std::mutex> lock(statusMutex);
+			if (ret != EXIT_SUCCESS) failed = true;
+			status << lineNumber << '\t' << (ret == EXIT_SUCCESS ? "OK" : "FAIL") << '\t'
+				<< (unsigned long long)ms << '\t' << message << '\n';
+			// Output not redirected to a file (e.g. --info) follows its status line
+			status << out.str();
+			status.flush();
+		});
+	}
+	pool.wait();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+} // namespace objmagic
@@ -0,0 +1,75 @@
+#pragma once
+
+// Command line style invocations shared by the obj-magic frontend and its batch modes
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <csignal>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Thread-safe cache of analyzing pass results, keyed by path and validated
+// against the file size and modification time. Least recently used entries are dropped.
+class AnalysisCache {
+public:
+	explicit AnalysisCache(size_t capacity = 4096): capacity(capacity) {}
+
+	// Returns the cached analysis of the opened source or runs the analyzing pass
+	Info analyze(Source& source);
+
+private:
+	struct Entry {
+		uint64_t size;
+		int64_t mtime;
+		Info info;
+		std::list<std::string>::iterator lru;
+	};
+
+	size_t capacity;
+	std::mutex mutex;
+	std::map<std::string, Entry> entries;
+	std::list<std::string> lru;
+};
+
+// Scratch state reused between invocations running on the same thread
+struct Workspace {
+	Source source;
+	AnalysisCache* cache = nullptr; // Optional, may be shared between workspaces
+	ThreadPool* pool = nullptr;     // For parallel operations, may be shared; one per invocation if null
+	std::string directory;          // Relative file names are resolved against this if set
+};
+
+// Run one invocation: the same parameters obj-magic takes, without the program name.
+// Results (and --info reports) go to out unless redirected with -o / -O,
+// error messages go to err. Returns the process exit code.
+int runCommand(const std::vector<std::string>& params, std::ostream& out, std::ostream& err, Workspace& workspace);
+
+// Split a line into parameters like a shell would: whitespace separates,
+// single and double quotes group, backslash escapes the next character.
+std::vector<std::string> splitCommandLine(const std::string& line);
+
+// Run every non-empty, non-comment line of the job list as its own invocation in parallel.
+// One tab separated status line per job goes to status: line number, OK or FAIL,
+// elapsed milliseconds and the input files or error message. Returns the process exit code.
+int runJobs(std::istream& jobs, std::ostream& status, unsigned threads = 0);
+
+// Serve invocations over a UNIX domain socket until stop becomes non-zero.
+// Each connection sends the client's working directory and one parameter line
+// (quoted like --jobs lines), each terminated by a newline. The reply is a header line
+// "OK <bytes>" or "FAIL <bytes>" followed by that many bytes of output or error message.
+// Connections are served concurrently and share buffers, the thread pool and the analysis
+// cache. The socket is only accessible to the daemon's user, and requests not sent within
+// a few seconds are dropped.
+int runDaemon(const std::string& socketPath, unsigned threads, std::ostream& log, const volatile std::sig_atomic_t& stop);
+
+// Send one invocation to a daemon and copy its reply to out (or err on failure).
+// Returns the process exit code.
+int runClient(const std::string& socketPath, const std::vector<std::string>& params, std::ostream& out, std::ostream& err);
+
+} // namespace objmagic
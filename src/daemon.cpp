@@ -0,0 +1,174 @@
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "command.hpp"
+#include "threadpool.hpp"
+
+#define MAX_REQUEST (1 << 20)
+#define REQUEST_TIMEOUT 10 // Seconds a client may take to send its request
+
+namespace objmagic {
+
+namespace {
+
+bool makeAddress(const std::string& path, sockaddr_un& addr, std::ostream& err) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		err << "Socket path too long: " << path << std::endl;
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+bool sendAll(int fd, const char* data, size_t length) {
+	while (length) {
+		ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return false;
+		data += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+// Reads until the peer closes or, if lines is non-zero, that many newlines have arrived
+bool receive(int fd, std::string& data, unsigned lines) {
+	char buffer[1 << 16];
+	for (;;) {
+		ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0) return false;
+		if (got == 0) return lines == 0;
+		data.append(buffer, got);
+		if (lines && (unsigned)std::count(data.begin(), data.end(), '\n') >= lines) return true;
+		if (data.size() > MAX_REQUEST && lines) return false;
+	}
+}
+
+std::string quote(const std::string& param) {
+	std::string quoted = "\"";
+	for (char c : param) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+void serve(int fd, Workspace& workspace) {
+	// A client that doesn't send its request would hold the worker forever
+	timeval timeout = { REQUEST_TIMEOUT, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::string request;
+	bool ok = receive(fd, request, 2);
+	std::ostringstream out, err;
+	int ret = EXIT_FAILURE;
+	if (ok) {
+		size_t eol = request.find('\n');
+		workspace.directory = request.substr(0, eol);
+		std::string line = request.substr(eol + 1, request.find('\n', eol + 1) - eol - 1);
+		ret = runCommand(splitCommandLine(line), out, err, workspace);
+	} else err << "Malformed or incomplete request" << std::endl;
+	std::string body = ret == EXIT_SUCCESS ? out.str() : err.str();
+	std::string header = (ret == EXIT_SUCCESS ? "OK " : "FAIL ") + std::to_string(body.size()) + "\n";
+	if (sendAll(fd, header.data(), header.size()))
+		sendAll(fd, body.data(), body.size());
+}
+
+} // namespace
+
+
+int runDaemon(const std::string& socketPath, unsigned threads, std::ostream& log, const volatile std::sig_atomic_t& stop) {
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr, log))
+		return EXIT_FAILURE;
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		log << "Failed to create socket: " << strerror(errno) << std::endl;
+		return EXIT_FAILURE;
+	}
+	unlink(socketPath.c_str()); // Stale socket from an earlier run
+	// Requests run with the daemon's permissions, so only its user may connect
+	mode_t mask = umask(0177);
+	int bound = bind(listener, (sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if (bound != 0 || listen(listener, 64) != 0) {
+		log << "Failed to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+		close(listener);
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool pool(threads);
+	AnalysisCache cache;
+	std::vector<Workspace> workspaces(pool.size());
+	for (Workspace& workspace : workspaces) {
+		workspace.cache = &cache;
+		workspace.pool = &pool;
+	}
+	log << OBJMAGIC_APPNAME << " " << OBJMAGIC_VERSION << " listening on " << socketPath
+		<< " with " << pool.size() << " threads" << std::endl;
+
+	// Poll with a timeout so a stop request is noticed even if the signal hit another thread
+	while (!stop) {
+		pollfd pfd = { listener, POLLIN, 0 };
+		int ready = poll(&pfd, 1, 200);
+		if (ready <= 0) continue;
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0) continue;
+		pool.enqueue([client, &workspaces](unsigned worker) {
+			serve(client, workspaces[worker]);
+			close(client);
+		});
+	}
+
+	pool.wait();
+	close(listener);
+	unlink(socketPath.c_str());
+	return EXIT_SUCCESS;
+}
+
+int runClient(const std::string& socketPath, const std::vector<std::string>& params, std::ostream& out, std::ostream& err) {
+	sockaddr_un addr;
+	if (!makeAddress(socketPath, addr, err))
+		return EXIT_FAILURE;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		err << "Failed to connect to " << socketPath << ": " << strerror(errno) << std::endl;
+		if (fd >= 0) close(fd);
+		return EXIT_FAILURE;
+	}
+
+	char cwd[4096];
+	std::string request = getcwd(cwd, sizeof(cwd)) ? cwd : "";
+	request += '\n';
+	for (const std::string& param : params)
+		request += quote(param) + " ";
+	request += '\n';
+
+	std::string reply;
+	bool ok = sendAll(fd, request.data(), request.size()) && receive(fd, reply, 0);
+	close(fd);
+	size_t eol = reply.find('\n');
+	if (!ok || eol == std::string::npos) {
+		err << "No reply from " << socketPath << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool success = reply.compare(0, 3, "OK ") == 0;
+	(success ? out : err).write(reply.data() + eol + 1, reply.size() - eol - 1);
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace objmagic
@@ -0,0 +1,438 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../glm/geometric.hpp"
+#include "decimate.hpp"
+#include "quadric.hpp"
+#include "parse.hpp"
+#include "threadpool.hpp"
+#include "triangulate.hpp"
+
+#define CLUSTER_BATCH (1 << 18)      // Faces or vertices handled together in parallel
+#define CLUSTER_SHARD_BITS 6         // The cell table is made of 2^this many independent parts
+#define CLUSTER_MAX_CELLS (1 << 24)  // Occupied cells allowed, each takes up to 256 bytes
+#define CLUSTER_MAX_CELLS_PER_AXIS (1 << 21)
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+static const uint64_t Empty = ~0ull;
+static const uint32_t Shards = 1u << CLUSTER_SHARD_BITS;
+
+inline bool startsWith(const char* row, size_t len, const char* prefix, size_t prefixLen) {
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+#define STARTS_WITH(row, len, prefix) startsWith(row, len, prefix, sizeof(prefix) - 1)
+
+inline uint64_t hashKey(uint64_t key) { return key * 0x9E3779B97F4A7C15ull; }
+inline uint32_t shardOf(uint64_t key) { return hashKey(key) >> (64 - CLUSTER_SHARD_BITS); }
+
+void appendIndex(std::string& out, uint64_t index) {
+	char tmp[24];
+	char* p = tmp + sizeof(tmp);
+	uint64_t value = index + 1;
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	out.append(p, tmp + sizeof(tmp) - p);
+}
+
+// Cells of the grid, numbered x first. Positions are handled in cell units from the lower
+// bound, which keeps the quadrics of far away models accurate.
+struct Grid {
+	vec3 origin;
+	float inverse;
+	uint64_t dims[3];
+
+	vec3 local(const vec3& p) const { return (p - origin) * inverse; }
+	uint64_t key(const vec3& local) const {
+		uint64_t cell[3];
+		for (int k = 0; k < 3; ++k) {
+			float c = std::floor(local[k]);
+			cell[k] = c <= 0.0f ? 0 : std::min((uint64_t)c, dims[k] - 1);
+		}
+		return cell[0] + dims[0] * (cell[1] + dims[1] * cell[2]);
+	}
+};
+
+struct Cell {
+	Quadric quadric;           // Of the faces around the vertices in the cell
+	uint64_t first = Empty;    // Vertex where the cell is written
+	uint64_t best = Empty;     // Vertex representing the cell
+	double bestError = 0.0;
+	uint64_t out = 0;          // Index of the cell's vertex in the output
+};
+
+// Open addressing hash table of cells by key, one shard of the whole
+class CellTable {
+public:
+	CellTable(): keys(16, Empty), cells(16) {}
+
+	Cell* find(uint64_t key) {
+		size_t mask = keys.size() - 1;
+		for (size_t i = slot(key) & mask;; i = (i + 1) & mask) {
+			if (keys[i] == key) return &cells[i];
+			if (keys[i] == Empty) return nullptr;
+		}
+	}
+
+	Cell& insert(uint64_t key) {
+		if ((count + 1) * 2 > keys.size()) grow();
+		size_t mask = keys.size() - 1;
+		size_t i = slot(key) & mask;
+		while (keys[i] != key && keys[i] != Empty) i = (i + 1) & mask;
+		if (keys[i] == Empty) {
+			keys[i] = key;
+			++count;
+		}
+		return cells[i];
+	}
+
+	size_t size() const { return count; }
+
+	template<typename Visit> void each(Visit visit) {
+		for (size_t i = 0; i < keys.size(); ++i)
+			if (keys[i] != Empty) visit(cells[i]);
+	}
+
+private:
+	// Bits of the hash below those choosing the shard
+	static size_t slot(uint64_t key) { return hashKey(key) >> 16; }
+
+	void grow() {
+		std::vector<uint64_t> oldKeys(keys.size() * 2, Empty);
+		std::vector<Cell> oldCells(cells.size() * 2);
+		std::swap(keys, oldKeys);
+		std::swap(cells, oldCells);
+		size_t mask = keys.size() - 1;
+		for (size_t j = 0; j < oldKeys.size(); ++j) {
+			if (oldKeys[j] == Empty) continue;
+			size_t i = slot(oldKeys[j]) & mask;
+			while (keys[i] != Empty) i = (i + 1) & mask;
+			keys[i] = oldKeys[j];
+			cells[i] = oldCells[j];
+		}
+	}
+
+	std::vector<uint64_t> keys;
+	std::vector<Cell> cells;
+	size_t count = 0;
+};
+
+class Clusterer {
+public:
+	Clusterer(const Grid& grid, ThreadPool& pool): grid(grid), pool(pool), tables(Shards) {}
+
+	bool addQuadrics(Source& source, std::string& error);
+	bool chooseVertices(std::string& error);
+	bool write(Source& source, Sink& out, std::string& error);
+	void report(Report& report) const;
+
+private:
+	// Orders the items with keys by shard into order, items of shard s being
+	// order[starts[s]] up to order[starts[s + 1]], and in their original order
+	void byShard(const std::vector<uint64_t>& keys);
+	bool checkSize(std::string& error) const;
+	void flushFaces();
+	// Every vertex has one once chooseVertices is done
+	Cell& cellOf(uint64_t vertex) {
+		uint64_t key = grid.key(grid.local(positions[vertex]));
+		return *tables[shardOf(key)].find(key);
+	}
+
+	const Grid& grid;
+	ThreadPool& pool;
+	std::vector<CellTable> tables;
+	std::vector<vec3> positions;
+
+	// Faces of the current batch, in CSR form
+	std::vector<uint64_t> offsets, corners;
+	std::vector<uint64_t> keys; // Of the cell of each corner, Empty if not known yet
+	std::vector<uint32_t> faceOf; // Of each corner
+	std::vector<Quadric> quadrics; // Of the plane of each face
+	std::vector<uint32_t> order;
+	std::vector<size_t> starts;
+
+	uint64_t triangles = 0, written = 0, degenerate = 0, cells = 0;
+};
+
+void Clusterer::byShard(const std::vector<uint64_t>& keys) {
+	starts.assign(Shards + 1, 0);
+	for (uint64_t key : keys)
+		if (key != Empty) ++starts[shardOf(key) + 1];
+	for (uint32_t s = 0; s < Shards; ++s) starts[s + 1] += starts[s];
+	order.resize(starts[Shards]);
+	std::vector<size_t> next(starts.begin(), starts.end() - 1);
+	for (size_t i = 0; i < keys.size(); ++i)
+		if (keys[i] != Empty) order[next[shardOf(keys[i])]++] = i;
+}
+
+bool Clusterer::checkSize(std::string& error) const {
+	size_t total = 0;
+	for (const CellTable& table : tables) total += table.size();
+	if (total <= CLUSTER_MAX_CELLS) return true;
+	error = "More than " + std::to_string(CLUSTER_MAX_CELLS) + " occupied cells, use a larger cell size";
+	return false;
+}
+
+void Clusterer::flushFaces() {
+	size_t count = offsets.size() - 1;
+	keys.assign(corners.size(), Empty);
+	faceOf.resize(corners.size());
+	quadrics.assign(count, Quadric());
+	parallelFor(pool, count, 4096, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; ++f) {
+			size_t first = offsets[f], n = offsets[f + 1] - first;
+			bool known = true;
+			for (size_t i = 0; i < n; ++i) known = known && corners[first + i] < positions.size();
+			if (!known) continue; // Refers to vertices further in the file
+			// Newell's normal, which is twice the area for a planar polygon
+			vec3 base = grid.local(positions[corners[first]]), normal(0.0f);
+			for (size_t i = 0; i < n; ++i) {
+				vec3 p = grid.local(positions[corners[first + i]]);
+				vec3 q = grid.local(positions[corners[first + (i + 1) % n]]);
+				normal += cross(p - base, q - base);
+				keys[first + i] = grid.key(p);
+				faceOf[first + i] = f;
+			}
+			float length = glm::length(normal);
+			if (length > 0.0f)
+				quadrics[f] = Quadric(normal / length, base, length * 0.5);
+		}
+	});
+	byShard(keys);
+	parallelFor(pool, Shards, 1, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; ++s)
+			for (size_t i = starts[s]; i < starts[s + 1]; ++i) {
+				uint32_t c = order[i];
+				tables[s].insert(keys[c]).quadric += quadrics[faceOf[c]];
+			}
+	});
+	offsets.assign(1, 0);
+	corners.clear();
+}
+
+bool Clusterer::addQuadrics(Source& source, std::string& error) {
+	ElementCounts sofar;
+	std::vector<uint64_t> tuples(3 * 16);
+	offsets.assign(1, 0);
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		if (STARTS_WITH(row, len, "v ")) {
+			vec3 p;
+			parseFloats(row + 2, &p.x, 3);
+			positions.push_back(p);
+			++sofar.v;
+		} else if (STARTS_WITH(row, len, "vt ")) {
+			++sofar.vt;
+		} else if (STARTS_WITH(row, len, "vn ")) {
+			++sofar.vn;
+		} else if (STARTS_WITH(row, len, "f ")) {
+			int n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+			if (n > (int)tuples.size() / 3) {
+				tuples.resize(3 * n);
+				n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], n);
+			}
+			if (n < 0) {
+				error = "Malformed face in " + source.name() + ": " + std::string(row, len);
+				return false;
+			}
+			if (n < 3) continue;
+			triangles += n - 2;
+			for (int i = 0; i < n; ++i) corners.push_back(tuples[i * 3]);
+			offsets.push_back(corners.size());
+			if (offsets.size() > CLUSTER_BATCH) {
+				flushFaces();
+				if (!checkSize(error)) return false;
+			}
+		}
+	}
+	flushFaces();
+	source.rewind();
+	return checkSize(error);
+}
+
+bool Clusterer::chooseVertices(std::string& error) {
+	// Every vertex gets a cell, also those no face uses
+	for (size_t batch = 0; batch < positions.size(); batch += CLUSTER_BATCH) {
+		size_t count = std::min<size_t>(CLUSTER_BATCH, positions.size() - batch);
+		keys.resize(count);
+		parallelFor(pool, count, 4096, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				keys[i] = grid.key(grid.local(positions[batch + i]));
+		});
+		byShard(keys);
+		parallelFor(pool, Shards, 1, [&](size_t begin, size_t end) {
+			for (size_t s = begin; s < end; ++s)
+				for (size_t i = starts[s]; i < starts[s + 1]; ++i) {
+					uint64_t v = batch + order[i];
+					Cell& cell = tables[s].insert(keys[order[i]]);
+					if (cell.first == Empty) cell.first = v;
+					double error = cell.quadric.error(grid.local(positions[v]));
+					if (cell.best == Empty || error < cell.bestError) {
+						cell.best = v;
+						cell.bestError = error;
+					}
+				}
+		});
+		if (!checkSize(error)) return false;
+	}
+
+	// Cells are written in the order of their first vertices
+	std::vector<std::pair<uint64_t, Cell*>> firsts;
+	for (CellTable& table : tables)
+		table.each([&firsts](Cell& cell) { firsts.emplace_back(cell.first, &cell); });
+	std::sort(firsts.begin(), firsts.end());
+	for (size_t i = 0; i < firsts.size(); ++i) firsts[i].second->out = i;
+	cells = firsts.size();
+	return true;
+}
+
+bool Clusterer::write(Source& source, Sink& out, std::string& error) {
+	ElementCounts sofar;
+	std::vector<uint64_t> tuples(3 * 16);
+	std::vector<vec3> polygon;
+	std::vector<uint32_t> split;
+	std::vector<uint64_t> mapped;
+	std::string line;
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		bool face = STARTS_WITH(row, len, "f ");
+		if (STARTS_WITH(row, len, "v ")) {
+			uint64_t v = sofar.v++;
+			Cell& cell = cellOf(v);
+			if (cell.first != v) continue;
+			if (cell.best == v) {
+				out.write(row, len);
+			} else {
+				const vec3& p = positions[cell.best];
+				out.write("v ", 2);
+				out.exactNumber(p.x); out.put(' '); out.exactNumber(p.y); out.put(' '); out.exactNumber(p.z);
+			}
+			out.put('\n');
+			continue;
+		}
+		if (STARTS_WITH(row, len, "vt ")) ++sofar.vt;
+		else if (STARTS_WITH(row, len, "vn ")) ++sofar.vn;
+		if (!face && !STARTS_WITH(row, len, "l ") && !STARTS_WITH(row, len, "p ")) {
+			out.write(row, len);
+			out.put('\n');
+			continue;
+		}
+
+		int n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+		if (n > (int)tuples.size() / 3) {
+			tuples.resize(3 * n);
+			n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], n);
+		}
+		bool valid = n >= 0;
+		for (int i = 0; i < n && valid; ++i) valid = tuples[i * 3] < positions.size();
+		if (!valid) {
+			error = "Invalid index in " + source.name() + ": " + std::string(row, len);
+			return false;
+		}
+		mapped.resize(n);
+		for (int i = 0; i < n; ++i) mapped[i] = cellOf(tuples[i * 3]).out;
+		auto append = [&](int i) {
+			line += ' ';
+			appendIndex(line, mapped[i]);
+			if (tuples[i * 3 + 1] != noIndex<uint64_t>()) {
+				line += '/';
+				appendIndex(line, tuples[i * 3 + 1]);
+				if (tuples[i * 3 + 2] != noIndex<uint64_t>()) {
+					line += '/';
+					appendIndex(line, tuples[i * 3 + 2]);
+				}
+			} else if (tuples[i * 3 + 2] != noIndex<uint64_t>()) {
+				line += "//";
+				appendIndex(line, tuples[i * 3 + 2]);
+			}
+		};
+
+		line.assign(row, 1);
+		if (row[0] == 'p') {
+			for (int i = 0; i < n; ++i) append(i);
+		} else if (row[0] == 'l') {
+			// Segments within a cell vanish
+			int kept = 0;
+			for (int i = 0; i < n; ++i) {
+				if (i > 0 && mapped[i] == mapped[i - 1]) continue;
+				append(i);
+				++kept;
+			}
+			if (kept < 2) continue;
+		} else {
+			if (n < 3) continue;
+			split.clear();
+			if (n == 3) {
+				split.assign({ 0, 1, 2 });
+			} else {
+				polygon.resize(n);
+				for (int i = 0; i < n; ++i) polygon[i] = positions[tuples[i * 3]];
+				triangulatePolygon(&polygon[0], n, split);
+			}
+			for (size_t t = 0; t < split.size(); t += 3) {
+				uint64_t a = mapped[split[t]], b = mapped[split[t + 1]], c = mapped[split[t + 2]];
+				if (a == b || b == c || a == c) {
+					++degenerate;
+					continue;
+				}
+				line.assign("f");
+				for (int k = 0; k < 3; ++k) append(split[t + k]);
+				line += '\n';
+				out.write(line);
+				++written;
+			}
+			continue;
+		}
+		line += '\n';
+		out.write(line);
+	}
+	out.flush();
+	if (!out.good()) {
+		error = "Failed to write output for " + source.name();
+		return false;
+	}
+	return true;
+}
+
+void Clusterer::report(Report& report) const {
+	report.add("Decimated", std::to_string(triangles) + " -> " + std::to_string(written) + " triangles");
+	report.add("Clusters", cells);
+	report.add("Degenerate", degenerate);
+}
+
+} // namespace
+
+bool clusterDecimate(Source& source, Sink& out, const Info& info, float cellSize, ThreadPool& pool,
+	std::string& error, Report* report)
+{
+	Grid grid;
+	grid.origin = info.lbound;
+	grid.inverse = 1.0f / cellSize;
+	vec3 size = info.size();
+	for (int k = 0; k < 3; ++k) {
+		double cells = std::ceil(std::max(size[k], 0.0f) * (double)grid.inverse);
+		if (cells > CLUSTER_MAX_CELLS_PER_AXIS) {
+			error = "Cell size is too small for the size of " + source.name();
+			return false;
+		}
+		grid.dims[k] = std::max(cells, 1.0);
+	}
+	Clusterer clusterer(grid, pool);
+	if (!clusterer.addQuadrics(source, error) || !clusterer.chooseVertices(error) || !clusterer.write(source, out, error))
+		return false;
+	if (report) clusterer.report(*report);
+	return true;
+}
+
+} // namespace objmagic
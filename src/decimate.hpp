@@ -0,0 +1,27 @@
+#pragma once
+
+// Decimation by clustering vertices on a uniform grid, for first passes over huge models
+
+#include <string>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Streams the source to out with the vertices in each cell of a grid with the given cell size,
+// laid over the bounds in info, merged into one. The vertex of a cell closest to the planes of
+// the faces around the cell (by their quadric, weighted by area) represents it, written where
+// the first vertex of the cell was, with the digits it needs to read back the same. Faces are
+// triangulated like --triangulate does and the triangles with two corners in one cell are
+// dropped, as are lines left with fewer than two vertices. Texture coordinates and normals
+// stay as they are.
+//
+// The source is read twice after the analyzing pass: once to add up the quadrics of the cells
+// and once to write the output. Memory is 12 bytes per vertex of the source for the
+// positions, plus a hash table of the occupied cells, which is bounded, so a finer grid
+// than it allows fails instead of running out of memory. Faces and vertices are handled in
+// large batches, each of them in parallel over chunks and then over shards of the table.
+bool clusterDecimate(Source& source, Sink& out, const Info& info, float cellSize, ThreadPool& pool,
+	std::string& error, Report* report);
+
+} // namespace objmagic
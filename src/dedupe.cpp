@@ -0,0 +1,112 @@
+#include <vector>
+#include <cstring>
+
+#include "dedupe.hpp"
+#include "clean.hpp"
+#include "threadpool.hpp"
+
+namespace objmagic {
+
+namespace {
+
+inline uint64_t mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+inline uint32_t floatBits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+} // namespace
+
+// The hash space is split into shards, each filled in element order by one thread
+// into its own open addressing table, so the result doesn't depend on the thread count.
+void firstOccurrences(const Array<float>* const columns[], int dims, Array<Index>& first, ThreadPool& pool) {
+	size_t count = columns[0]->size();
+	first.resize(count);
+	std::vector<uint64_t> hashes(count);
+	parallelFor(pool, count, 1 << 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			uint64_t h = 0;
+			for (int d = 0; d < dims; ++d)
+				h = mix(h ^ floatBits((*columns[d])[i]));
+			hashes[i] = h;
+		}
+	});
+	auto equal = [columns, dims](size_t a, size_t b) {
+		for (int d = 0; d < dims; ++d)
+			if (floatBits((*columns[d])[a]) != floatBits((*columns[d])[b])) return false;
+		return true;
+	};
+
+	size_t shards = count < (1 << 16) ? 1 : 16;
+	parallelFor(pool, shards, 1, [&](size_t begin, size_t end) {
+		for (size_t shard = begin; shard < end; ++shard) {
+			size_t size = 0;
+			for (size_t i = 0; i < count; ++i)
+				if ((hashes[i] >> 60) % shards == shard) ++size;
+			size_t capacity = 16;
+			while (capacity < size * 2) capacity *= 2;
+			std::vector<Index> table(capacity, NoIndex);
+			size_t mask = capacity - 1;
+			for (size_t i = 0; i < count; ++i) {
+				if ((hashes[i] >> 60) % shards != shard) continue;
+				size_t slot = hashes[i] & mask;
+				first[i] = i;
+				for (; table[slot] != NoIndex; slot = (slot + 1) & mask) {
+					Index j = table[slot];
+					if (hashes[j] == hashes[i] && equal(i, j)) {
+						first[i] = j;
+						break;
+					}
+				}
+				if (first[i] == i) table[slot] = i;
+			}
+		}
+	});
+}
+
+void dedupe(Mesh& mesh, ThreadPool& pool, Report* report) {
+	const Array<float>* const vertexColumns[] = { &mesh.px, &mesh.py, &mesh.pz };
+	const Array<float>* const texCoordColumns[] = { &mesh.tu, &mesh.tv };
+	const Array<float>* const normalColumns[] = { &mesh.nx, &mesh.ny, &mesh.nz };
+	Array<Index> first[3];
+	firstOccurrences(vertexColumns, 3, first[0], pool);
+	firstOccurrences(texCoordColumns, 2, first[1], pool);
+	firstOccurrences(normalColumns, 3, first[2], pool);
+
+	Bitset keep[3];
+	for (int k = 0; k < 3; ++k) {
+		keep[k].resize(first[k].size());
+		for (size_t i = 0; i < first[k].size(); ++i)
+			if (first[k][i] == i) keep[k].set(i);
+	}
+
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	for (Elements* list : lists) {
+		Array<Index>* const corners[] = { &list->v, &list->vt, &list->vn };
+		for (size_t i = 0; i < list->size(); ++i) {
+			for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+				for (int k = 0; k < 3; ++k) {
+					Index& index = (*corners[k])[c];
+					if (index == NoIndex || first[k][index] == index) continue;
+					index = first[k][index];
+					list->dirty.set(i);
+				}
+			}
+		}
+	}
+
+	Remap v(keep[0]), vt(keep[1]), vn(keep[2]);
+	if (report) reportRemoved(*report, v, vt, vn);
+	removeElements(mesh, v, vt, vn);
+}
+
+} // namespace objmagic
@@ -0,0 +1,16 @@
+#pragma once
+
+// Merging of vertices, texture coordinates and normals with identical values
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Finds for each element the first element with bitwise identical values in all columns
+void firstOccurrences(const Array<float>* const columns[], int dims, Array<Index>& first, ThreadPool& pool);
+
+// Points every element to the first one with the same value and removes the rest
+void dedupe(Mesh& mesh, ThreadPool& pool, Report* report);
+
+} // namespace objmagic
@@ -0,0 +1,55 @@
+#include <cstring>
+
+#include "filter.hpp"
+
+namespace objmagic {
+
+namespace {
+
+inline bool isKeyword(const char* row, size_t len, const char* keyword, size_t keywordLen) {
+	return len > keywordLen && memcmp(row, keyword, keywordLen) == 0 && (row[keywordLen] == ' ' || row[keywordLen] == '\t');
+}
+
+} // namespace
+
+std::string recordName(const char* row, size_t len, size_t keyword) {
+	const char* p = row + keyword;
+	const char* end = row + len;
+	const char* hash = (const char*)memchr(p, '#', end - p);
+	if (hash) end = hash;
+	while (p < end && (*p == ' ' || *p == '\t')) ++p;
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+	return std::string(p, end - p);
+}
+
+ElementFilter::ElementFilter(const Options& options):
+	materials(options.deleteMaterials.begin(), options.deleteMaterials.end()),
+	groups(options.deleteGroups.begin(), options.deleteGroups.end()),
+	objects(options.deleteObjects.begin(), options.deleteObjects.end())
+{}
+
+bool ElementFilter::update(const char* row, size_t len) {
+	if (!materials.empty() && isKeyword(row, len, "usemtl", 6)) {
+		material = materials.count(recordName(row, len, 6)) > 0;
+		return !material;
+	}
+	if (!objects.empty() && isKeyword(row, len, "o", 1)) {
+		object = objects.count(recordName(row, len, 1)) > 0;
+		return !object;
+	}
+	if (!groups.empty() && isKeyword(row, len, "g", 1)) {
+		// An element in several groups goes if any of them is deleted
+		std::string names = recordName(row, len, 1);
+		group = false;
+		for (size_t pos = 0; pos < names.size() && !group;) {
+			size_t next = names.find_first_of(" \t", pos);
+			if (next == std::string::npos) next = names.size();
+			group = next > pos && groups.count(names.substr(pos, next - pos)) > 0;
+			pos = next + 1;
+		}
+		return !group;
+	}
+	return true;
+}
+
+} // namespace objmagic
@@ -0,0 +1,37 @@
+#pragma once
+
+// Deletion of elements by material, group or object name while streaming
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// The name or names after the keyword of a usemtl, g or o record (keyword characters long),
+// without surrounding whitespace or trailing comment
+std::string recordName(const char* row, size_t len, size_t keyword);
+
+class ElementFilter {
+public:
+	explicit ElementFilter(const Options& options);
+
+	// Whether any names were given to delete
+	bool active() const { return !materials.empty() || !groups.empty() || !objects.empty(); }
+
+	// Follows usemtl, g and o records. Returns false for a record that itself names
+	// something deleted, which the caller should drop as well.
+	bool update(const char* row, size_t len);
+	// Whether f, l and p records at the current position are deleted
+	bool deleting() const { return material || group || object; }
+	// Forgets the state, for another pass over the source
+	void rewind() { material = group = object = false; }
+
+private:
+	std::set<std::string> materials, groups, objects;
+	bool material = false, group = false, object = false;
+};
+
+} // namespace objmagic
@@ -0,0 +1,124 @@
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "lod.hpp"
+
+namespace objmagic {
+
+namespace {
+
+std::string format(double value) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%.3g", value);
+	return tmp;
+}
+
+std::string objectRecord(const std::string& name, size_t level) {
+	return "o " + (name.empty() ? std::string() : name + "_") + "LOD" + std::to_string(level);
+}
+
+// Appends the faces of the mesh to faces, numbered from first in records, along with the
+// material, group and smoothing records they are under. Records no face follows anymore are
+// left out.
+void copyLevel(Mesh& mesh, Elements& faces, Index first, std::vector<Record>& records) {
+	const RecordKind kinds[3] = { RecordMaterial, RecordGroup, RecordSmoothing };
+	const char* const resets[3] = { nullptr, "g default", "s off" };
+	bool used[3] = {};
+	for (const Record& record : mesh.records)
+		for (int k = 0; k < 3; ++k) used[k] = used[k] || record.kind == kinds[k];
+	Index pending[3] = { NoIndex, NoIndex, NoIndex };
+	bool started = false;
+	for (const Record& record : mesh.records) {
+		for (int k = 0; k < 3; ++k)
+			if (record.kind == kinds[k]) pending[k] = record.index;
+		if (record.kind != RecordFace) continue;
+		for (int k = 0; k < 3; ++k) {
+			// The level before ended under its own group and smoothing group
+			if (!started && pending[k] == NoIndex && used[k] && resets[k]) pending[k] = mesh.addText(resets[k]);
+			if (pending[k] != NoIndex) records.push_back(Record{ NoLine, pending[k], kinds[k] });
+			pending[k] = NoIndex;
+		}
+		started = true;
+		Index f = record.index;
+		for (Index c = mesh.faces.offsets[f]; c < mesh.faces.offsets[f + 1]; ++c) {
+			faces.v.push_back(mesh.faces.v[c]);
+			faces.vt.push_back(mesh.faces.vt[c]);
+			faces.vn.push_back(mesh.faces.vn[c]);
+		}
+		faces.offsets.push_back(faces.v.size());
+		records.push_back(Record{ NoLine, first + (Index)faces.size() - 1, RecordFace });
+	}
+}
+
+} // namespace
+
+std::vector<SimplifyStats> buildLodChain(Mesh& mesh, const std::vector<double>& ratios, const std::string& name,
+	ThreadPool& pool, Report* report)
+{
+	typedef std::chrono::steady_clock Clock;
+	size_t triangles = 0;
+	for (size_t f = 0; f < mesh.faces.size(); ++f)
+		if (mesh.faces.corners(f) >= 3) triangles += mesh.faces.corners(f) - 2;
+
+	// Simplifying changes the faces of the mesh, which get the ones of the source back below
+	Elements faces = mesh.faces;
+	Array<Record> sourceRecords = mesh.records;
+	Elements levels(&mesh.arena);
+	std::vector<Record> levelRecords;
+	std::vector<SimplifyStats> result;
+	std::vector<double> times;
+	for (size_t i = 0; i < ratios.size(); ++i) {
+		auto start = Clock::now();
+		size_t goal = (size_t)std::llround(ratios[i] * triangles);
+		size_t current = result.empty() ? triangles : result.back().after;
+		// A target of at most 1 is a fraction for simplify
+		double target = goal > 1 ? (double)goal : current ? (double)goal / current : 0.0;
+		result.push_back(simplify(mesh, target, pool, nullptr));
+		levelRecords.push_back(Record{ NoLine, mesh.addText(objectRecord(name, i + 1)), RecordObject });
+		copyLevel(mesh, levels, faces.size(), levelRecords);
+		times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+
+	// Faces of the source first, then those of the levels
+	Index count = faces.size(), corners = faces.v.size();
+	for (size_t i = 0; i < levels.size(); ++i)
+		faces.offsets.push_back(corners + levels.offsets[i + 1]);
+	faces.v.insert(faces.v.end(), levels.v.begin(), levels.v.end());
+	faces.vt.insert(faces.vt.end(), levels.vt.begin(), levels.vt.end());
+	faces.vn.insert(faces.vn.end(), levels.vn.begin(), levels.vn.end());
+	faces.dirty.resize(faces.size());
+	faces.relative.resize(faces.size());
+	for (size_t i = count; i < faces.size(); ++i) faces.dirty.set(i);
+	std::swap(mesh.faces, faces);
+
+	Array<Record> records((ArenaAllocator<Record>(&mesh.arena)));
+	records.reserve(sourceRecords.size() + levelRecords.size() + 1);
+	bool named = false;
+	for (const Record& record : sourceRecords) {
+		if (record.kind == RecordObject) continue;
+		// Before the first element or text record that belongs to one
+		if (!named && record.kind >= RecordFace) {
+			records.push_back(Record{ NoLine, mesh.addText(objectRecord(name, 0)), RecordObject });
+			named = true;
+		}
+		records.push_back(record);
+	}
+	if (!named) records.push_back(Record{ NoLine, mesh.addText(objectRecord(name, 0)), RecordObject });
+	records.insert(records.end(), levelRecords.begin(), levelRecords.end());
+	std::swap(mesh.records, records);
+	mesh.updateRanges();
+
+	if (report) {
+		report->add("LOD0", std::to_string(triangles) + " triangles");
+		for (size_t i = 0; i < result.size(); ++i) {
+			report->add("LOD" + std::to_string(i + 1), std::to_string(result[i].after) + " triangles, error "
+				+ format(result[i].error) + ", " + format(times[i]) + " ms");
+		}
+	}
+	return result;
+}
+
+} // namespace objmagic
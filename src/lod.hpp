@@ -0,0 +1,25 @@
+#pragma once
+
+// Chains of levels of detail, each simplified from the one before
+
+#include <string>
+#include <vector>
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+#include "simplify.hpp"
+
+namespace objmagic {
+
+// Appends levels of detail with ratios[i] of the triangles of the mesh to it, simplifying each
+// level from the one before, so that the model is loaded once and every simplification starts
+// from fewer triangles. The faces of the mesh become object NAME_LOD0 and the levels objects
+// NAME_LOD1, NAME_LOD2, ... (LOD0, LOD1, ... if name is empty), in place of the o records of
+// the source. Levels keep the material, group and smoothing records of their faces and share
+// the vertices, texture coordinates and normals of the mesh, as collapses don't add any.
+// Returns the statistics of the levels after the first, errors being relative to the level
+// before, and reports their triangles, errors and times.
+std::vector<SimplifyStats> buildLodChain(Mesh& mesh, const std::vector<double>& ratios, const std::string& name,
+	ThreadPool& pool, Report* report);
+
+} // namespace objmagic
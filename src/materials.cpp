@@ -0,0 +1,295 @@
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+
+#include "materials.hpp"
+#include "parse.hpp"
+
+namespace objmagic {
+
+namespace {
+
+inline bool isElement(const char* row, size_t len) {
+	return len >= 2 && row[1] == ' ' && (row[0] == 'f' || row[0] == 'l' || row[0] == 'p');
+}
+
+inline bool startsWith(const char* row, size_t len, const char* prefix) {
+	size_t prefixLen = strlen(prefix);
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+
+// Writes the element row with relative indices resolved against sofar
+void makeAbsolute(const char* row, size_t len, const ElementCounts& sofar, std::string& out) {
+	const uint64_t counts[3] = { sofar.v, sofar.vt, sofar.vn };
+	const char* end = row + len;
+	const char* p = row;
+	out.clear();
+	int slot = 0;
+	while (p < end && *p != '#') {
+		char c = *p;
+		if (c == ' ' || c == '\t') slot = 0;
+		else if (c == '/') ++slot;
+		if (c != '-' || slot > 2) {
+			out += c;
+			++p;
+			continue;
+		}
+		uint64_t value = 0;
+		const char* digits = ++p;
+		for (; p < end && detail::isDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+		if (p == digits || value > counts[slot]) {
+			// Not a valid index, leave it for the reader to complain about
+			out += '-';
+			out.append(digits, p - digits);
+			continue;
+		}
+		out += std::to_string(counts[slot] - value + 1);
+	}
+	out.append(p, end - p);
+}
+
+// Where the elements are while regrouping: (material, context, length, text) records
+// in memory, or in a temp file once a bucket has more than fits
+struct Bucket {
+	std::string data;
+	FILE* file = nullptr;
+
+	~Bucket() { if (file) fclose(file); }
+
+	static void append(std::string& data, uint32_t material, uint32_t context, const std::string& text) {
+		uint32_t header[3] = { material, context, (uint32_t)text.size() };
+		data.append((const char*)header, sizeof(header));
+		data.append(text);
+	}
+
+	bool spill(std::string& error) {
+		if (!file && !(file = tmpfile())) {
+			error = "Failed to create temp file for regrouping";
+			return false;
+		}
+		if (fwrite(data.data(), 1, data.size(), file) != data.size()) {
+			error = "Failed to write temp file for regrouping";
+			return false;
+		}
+		data.clear();
+		return true;
+	}
+};
+
+// Material, group, object and smoothing state of an element
+struct Context {
+	std::string object, group, smoothing;
+};
+
+} // namespace
+
+bool optimizeMaterials(Source& source, Sink& out, size_t bufferSize, std::string& error, Report* report) {
+	// Sizing pass: materials in order of first use and their element bytes
+	std::unordered_map<std::string, uint32_t> materialIds;
+	std::vector<std::string> materials; // The usemtl rows, empty for elements before any
+	std::vector<uint64_t> bytes;
+	std::vector<uint32_t> runs;
+	uint32_t material = 0, last = ~0u;
+	bool grouped = true;
+	uint64_t runsBefore = 0;
+	materials.push_back("");
+	bytes.push_back(0);
+	runs.push_back(0);
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		if (startsWith(row, len, "usemtl ")) {
+			std::string name(row, len);
+			auto it = materialIds.find(name);
+			if (it == materialIds.end()) {
+				it = materialIds.emplace(name, materials.size()).first;
+				materials.push_back(name);
+				bytes.push_back(0);
+				runs.push_back(0);
+			}
+			material = it->second;
+		} else if (isElement(row, len)) {
+			if (material != last) {
+				++runsBefore;
+				if (++runs[material] > 1) grouped = false;
+				last = material;
+			}
+			bytes[material] += len + 2 * sizeof(uint32_t) + 16;
+		}
+	}
+	source.rewind();
+	if (report) report->add("Runs before", runsBefore);
+	if (grouped) {
+		while (source.readLine(row, len)) {
+			out.write(row, len);
+			out.put('\n');
+		}
+		if (report) report->add("Runs after", runsBefore);
+		out.flush();
+		return out.good();
+	}
+
+	// Consecutive materials share a bucket while they fit in the buffer
+	std::vector<uint32_t> bucketOf(materials.size());
+	std::vector<std::vector<uint32_t>> bucketMaterials(1);
+	uint64_t filled = 0;
+	for (uint32_t m = 0; m < materials.size(); ++m) {
+		if (!bytes[m]) continue;
+		if (filled && filled + bytes[m] > bufferSize) {
+			bucketMaterials.emplace_back();
+			filled = 0;
+		}
+		filled += bytes[m];
+		bucketOf[m] = bucketMaterials.size() - 1;
+		bucketMaterials.back().push_back(m);
+	}
+	bool spilling = bucketMaterials.size() > 1;
+	size_t chunk = std::max<size_t>(bufferSize / bucketMaterials.size(), 1 << 16);
+	std::vector<std::unique_ptr<Bucket>> buckets;
+	for (size_t b = 0; b < bucketMaterials.size(); ++b)
+		buckets.emplace_back(new Bucket());
+
+	// Distribution pass: everything but the elements and their state goes out right away
+	std::map<std::string, uint32_t> contextIds;
+	std::vector<Context> contexts;
+	Context context;
+	uint32_t contextId = ~0u;
+	ElementCounts sofar;
+	std::string text;
+	material = 0;
+	while (source.readLine(row, len)) {
+		if (startsWith(row, len, "usemtl ")) {
+			material = materialIds[std::string(row, len)];
+			continue;
+		}
+		std::string* state = startsWith(row, len, "o ") ? &context.object
+			: startsWith(row, len, "g ") ? &context.group
+			: startsWith(row, len, "s ") ? &context.smoothing : nullptr;
+		if (state) {
+			state->assign(row, len);
+			contextId = ~0u;
+			continue;
+		}
+		if (!isElement(row, len)) {
+			if (len >= 2 && row[0] == 'v') {
+				if (row[1] == ' ') ++sofar.v;
+				else if (startsWith(row, len, "vt ")) ++sofar.vt;
+				else if (startsWith(row, len, "vn ")) ++sofar.vn;
+			}
+			out.write(row, len);
+			out.put('\n');
+			continue;
+		}
+		if (contextId == ~0u) {
+			std::string key = context.object + '\n' + context.group + '\n' + context.smoothing;
+			auto it = contextIds.find(key);
+			if (it == contextIds.end()) {
+				it = contextIds.emplace(key, contexts.size()).first;
+				contexts.push_back(context);
+			}
+			contextId = it->second;
+		}
+		if (memchr(row, '-', len)) makeAbsolute(row, len, sofar, text);
+		else text.assign(row, len);
+		Bucket& bucket = *buckets[bucketOf[material]];
+		Bucket::append(bucket.data, material, contextId, text);
+		if (spilling && bucket.data.size() >= chunk && !bucket.spill(error))
+			return false;
+	}
+	source.rewind();
+
+	// Output pass, bucket by bucket
+	Context written;
+	uint64_t runsAfter = 0;
+	uint32_t pending = ~0u; // Material to switch to before the next element, after its o/g/s rows
+	// Elements from before any o, g or s row get the default object and group and no smoothing
+	// back, instead of staying under the ones written for the material before
+	auto writeState = [&out](const std::string& state, std::string& current, const char* reset) {
+		if (state == current) return;
+		current = state;
+		out.write(state.empty() ? std::string(reset) : state);
+		out.put('\n');
+	};
+	auto writeElement = [&](const char* record) {
+		uint32_t header[3];
+		memcpy(header, record, sizeof(header));
+		const Context& state = contexts[header[1]];
+		writeState(state.object, written.object, "o default");
+		writeState(state.group, written.group, "g default");
+		writeState(state.smoothing, written.smoothing, "s off");
+		if (pending != ~0u && !materials[pending].empty()) {
+			out.write(materials[pending]);
+			out.put('\n');
+		}
+		pending = ~0u;
+		out.write(record + sizeof(header), header[2]);
+		out.put('\n');
+	};
+	auto writeMaterial = [&](uint32_t m) {
+		++runsAfter;
+		pending = m;
+	};
+	std::vector<std::vector<size_t>> records(materials.size());
+	size_t tempFiles = 0;
+	for (size_t b = 0; b < buckets.size(); ++b) {
+		Bucket& bucket = *buckets[b];
+		const std::vector<uint32_t>& members = bucketMaterials[b];
+		if (bucket.file && !bucket.spill(error))
+			return false;
+		if (bucket.file) ++tempFiles;
+
+		// A single material is already in order and may be larger than the buffer
+		if (members.size() == 1 && bucket.file) {
+			writeMaterial(members[0]);
+			rewind(bucket.file);
+			std::string record;
+			uint32_t header[3];
+			while (fread(header, sizeof(header), 1, bucket.file) == 1) {
+				record.resize(sizeof(header) + header[2]);
+				memcpy(&record[0], header, sizeof(header));
+				if (header[2] && fread(&record[sizeof(header)], header[2], 1, bucket.file) != 1) break;
+				writeElement(record.data());
+			}
+			continue;
+		}
+
+		if (bucket.file) {
+			long size = ftell(bucket.file);
+			rewind(bucket.file);
+			bucket.data.resize(size);
+			if (size && fread(&bucket.data[0], 1, size, bucket.file) != (size_t)size) {
+				error = "Failed to read temp file for regrouping";
+				return false;
+			}
+		}
+		for (size_t pos = 0; pos < bucket.data.size();) {
+			uint32_t header[3];
+			memcpy(header, &bucket.data[pos], sizeof(header));
+			records[header[0]].push_back(pos);
+			pos += sizeof(header) + header[2];
+		}
+		for (uint32_t m : members) {
+			writeMaterial(m);
+			for (size_t pos : records[m])
+				writeElement(&bucket.data[pos]);
+			std::vector<size_t>().swap(records[m]);
+		}
+		std::string().swap(bucket.data);
+	}
+	if (report) {
+		report->add("Runs after", runsAfter);
+		if (spilling) report->add("Temp files", tempFiles);
+	}
+	out.flush();
+	if (!out.good()) {
+		error = "Failed to write output for " + source.name();
+		return false;
+	}
+	return true;
+}
+
+} // namespace objmagic
@@ -0,0 +1,21 @@
+#pragma once
+
+// Regrouping of faces by material
+
+#include <string>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Streams the source to out so that the f, l and p records of each material form a single
+// run, keeping their order within the material. Materials follow in order of first use, each
+// after one usemtl record, with o, g and s records repeated where the faces need them, and
+// o default, g default or s off where they had none in effect. The rest of the records come
+// first, in their original order, and relative indices are made absolute. Faces are buffered
+// in memory up to about bufferSize bytes, beyond that in temp files holding consecutive
+// materials, so any size of source can be regrouped.
+// A source that is already grouped is copied as is.
+bool optimizeMaterials(Source& source, Sink& out, size_t bufferSize, std::string& error, Report* report);
+
+} // namespace objmagic
@@ -0,0 +1,274 @@
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+
+#include "merge.hpp"
+#include "parse.hpp"
+
+namespace objmagic {
+
+namespace {
+
+inline bool startsWith(const char* row, size_t len, const char* prefix) {
+	size_t prefixLen = strlen(prefix);
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+
+// File name without directory and .obj extension
+std::string baseName(const std::string& path) {
+	size_t slash = path.find_last_of('/');
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+		name.resize(name.size() - 4);
+	return name;
+}
+
+// Writes the f, l or p record with its absolute indices increased by offsets (v, vt, vn)
+void offsetIndices(const char* row, size_t len, const uint64_t offsets[3], Sink& out) {
+	const char* p = row + 2;
+	const char* end = row + len;
+	out.write(row, 2);
+	int slot = 0;
+	char number[24];
+	while (p < end && *p != '#') {
+		char c = *p;
+		if (c == ' ' || c == '\t') slot = 0;
+		else if (c == '/') ++slot;
+		if (c == '-') {
+			// Relative indices still refer to the same records
+			const char* start = p;
+			for (++p; p < end && detail::isDigit(*p); ++p) {}
+			out.write(start, p - start);
+			continue;
+		}
+		if (!detail::isDigit(c) || slot > 2) {
+			out.put(c);
+			++p;
+			continue;
+		}
+		uint64_t value = 0;
+		for (; p < end && detail::isDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+		value += offsets[slot];
+		char* digits = number + sizeof(number);
+		do {
+			*--digits = '0' + value % 10;
+			value /= 10;
+		} while (value);
+		out.write(digits, number + sizeof(number) - digits);
+	}
+	out.write(p, end - p);
+	out.put('\n');
+}
+
+// Group, smoothing and material records, which stay in effect until the next one of their kind
+enum StateKind { StateGroup, StateSmoothing, StateMaterial, StateKinds };
+
+StateKind stateKind(const char* row, size_t len) {
+	return startsWith(row, len, "g ") ? StateGroup : startsWith(row, len, "s ") ? StateSmoothing
+		: startsWith(row, len, "usemtl ") ? StateMaterial : StateKinds;
+}
+
+// Whether the state record sets the default group, no smoothing or the default material
+bool isDefaultState(const char* row, size_t len) {
+	const char* end = row + len;
+	const char* hash = (const char*)memchr(row, '#', len);
+	if (hash) end = hash;
+	const char* value = (const char*)memchr(row, ' ', end - row);
+	for (; value < end && (*value == ' ' || *value == '\t'); ++value) {}
+	while (end > value && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+	std::string name(value, end - value);
+	return name == "default" || (row[0] == 's' && (name == "off" || name == "0"));
+}
+
+// Loads the files into memory ahead of the merge on a background thread, holding at most
+// about bufferSize bytes at a time. Files larger than that are left to be read from disk.
+class Prefetcher {
+public:
+	Prefetcher(const std::vector<std::string>& paths, size_t bufferSize):
+		paths(paths), files(paths.size()), bufferSize(bufferSize), thread([this]() { run(); })
+	{}
+
+	~Prefetcher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		space.notify_all();
+		thread.join();
+	}
+
+	// Waits for file i and opens it, from memory if it was loaded
+	bool open(size_t i, Source& source, std::string& error) {
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [this, i]() { return files[i].state != Pending; });
+		if (files[i].state == Loaded) {
+			source.openMemory(files[i].data.data(), files[i].data.size(), paths[i]);
+			return true;
+		}
+		lock.unlock();
+		return source.open(paths[i], error);
+	}
+
+	// Frees file i once the source opened from it is closed
+	void release(size_t i) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			loaded -= files[i].data.size();
+			std::vector<char>().swap(files[i].data);
+		}
+		space.notify_all();
+	}
+
+	size_t prefetched() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return count;
+	}
+
+private:
+	enum State { Pending, Loaded, Streamed };
+	struct File {
+		std::vector<char> data;
+		State state = Pending;
+	};
+
+	void run() {
+		for (size_t i = 0; i < files.size(); ++i) {
+			// Failures are left for open to report
+			FILE* file = fopen(paths[i].c_str(), "rb");
+			long long size = -1;
+			if (file && fseeko(file, 0, SEEK_END) == 0) size = ftello(file);
+			std::unique_lock<std::mutex> lock(mutex);
+			bool fits = size >= 0 && (size_t)size <= bufferSize;
+			space.wait(lock, [&]() { return stopping || !fits || loaded == 0 || loaded + size <= bufferSize; });
+			if (stopping) {
+				if (file) fclose(file);
+				return;
+			}
+			State state = Streamed;
+			if (fits) {
+				loaded += size;
+				lock.unlock();
+				std::vector<char> data(size);
+				fseeko(file, 0, SEEK_SET);
+				bool ok = size == 0 || fread(&data[0], size, 1, file) == 1;
+				lock.lock();
+				if (ok) {
+					files[i].data.swap(data);
+					state = Loaded;
+					++count;
+				} else loaded -= size;
+			}
+			files[i].state = state;
+			lock.unlock();
+			if (file) fclose(file);
+			ready.notify_all();
+		}
+	}
+
+	const std::vector<std::string>& paths;
+	std::vector<File> files;
+	size_t bufferSize;
+	size_t loaded = 0; // Bytes held in files
+	size_t count = 0;
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable ready, space;
+	std::thread thread;
+};
+
+} // namespace
+
+bool mergeFiles(const std::vector<std::string>& paths, Sink& out, bool prefixNames, size_t bufferSize,
+	std::string& error, Report* report)
+{
+	Prefetcher prefetcher(paths, bufferSize);
+	std::set<std::string> libraries; // mtllib records written
+	uint64_t offsets[3] = {}; // v, vt and vn before the current file
+	// The state a file starts in is the default one, not where the file before left off
+	static const char* const resets[StateKinds] = { "g default\n", "s off\n", "usemtl default\n" };
+	bool changed[StateKinds] = {}; // State set by a record and not reset since
+	std::string prefixed;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		Source source;
+		if (!prefetcher.open(i, source, error))
+			return false;
+		std::string prefix = prefixNames ? baseName(paths[i]) : "";
+		bool inObject = !prefixNames;
+		uint64_t counts[3] = {};
+		bool reset[StateKinds]; // Left to reset before the first element of this file
+		std::copy(changed, changed + StateKinds, reset);
+		const char* row;
+		size_t len;
+		while (source.readLine(row, len)) {
+			StateKind state = stateKind(row, len);
+			if (state != StateKinds) {
+				// Group names get a prefix, so not even g default is the default group anymore
+				changed[state] = !isDefaultState(row, len) || (prefixNames && state == StateGroup);
+				reset[state] = false;
+			}
+			if (len >= 2 && row[0] == 'v') {
+				int kind = row[1] == ' ' ? 0 : (len >= 3 && row[2] == ' ') ? (row[1] == 't' ? 1 : row[1] == 'n' ? 2 : -1) : -1;
+				if (kind >= 0) ++counts[kind];
+			} else if (len >= 2 && row[1] == ' ' && (row[0] == 'f' || row[0] == 'l' || row[0] == 'p')) {
+				if (!inObject) {
+					out.write("o " + prefix + "\n");
+					inObject = true;
+				}
+				for (int k = 0; k < StateKinds; ++k) {
+					if (!reset[k]) continue;
+					out.write(resets[k]);
+					changed[k] = reset[k] = false;
+				}
+				if (offsets[0] || offsets[1] || offsets[2]) {
+					offsetIndices(row, len, offsets, out);
+					continue;
+				}
+			} else if (prefixNames && (startsWith(row, len, "o ") || startsWith(row, len, "g "))) {
+				// The object name, or every name of a group record, gets the prefix
+				bool object = row[0] == 'o';
+				inObject |= object;
+				prefixed.assign(row, 1);
+				const char* end = row + len;
+				const char* hash = (const char*)memchr(row, '#', len);
+				if (hash) end = hash;
+				while (end > row + 1 && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+				for (const char* p = row + 1; p < end;) {
+					for (; p < end && (*p == ' ' || *p == '\t'); ++p)
+						prefixed += *p;
+					const char* name = p;
+					while (p < end && (object || (*p != ' ' && *p != '\t'))) ++p;
+					if (p > name) prefixed += prefix + '_' + std::string(name, p - name);
+				}
+				prefixed.append(end, row + len - end);
+				out.write(prefixed);
+				out.put('\n');
+				continue;
+			} else if (startsWith(row, len, "mtllib ")) {
+				if (!libraries.insert(std::string(row, len)).second) continue;
+			}
+			out.write(row, len);
+			out.put('\n');
+		}
+		source.close();
+		prefetcher.release(i);
+		for (int k = 0; k < 3; ++k)
+			offsets[k] += counts[k];
+	}
+	if (report) {
+		report->add("Merged files", paths.size());
+		report->add("Prefetched", prefetcher.prefetched());
+	}
+	out.flush();
+	if (!out.good()) {
+		error = "Failed to write merged output";
+		return false;
+	}
+	return true;
+}
+
+} // namespace objmagic
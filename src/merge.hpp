@@ -0,0 +1,24 @@
+#pragma once
+
+// Concatenation of several models into one
+
+#include <string>
+#include <vector>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Writes the files one after another as a single model. Absolute indices are offset by the
+// v, vt and vn records of the files before, relative ones stay as they are, and mtllib records
+// already written are left out. With prefixNames, o and g names get the file name (without
+// directory and .obj) and '_' in front of them, and files with elements outside any object
+// get an o record named after the file. Each file starts out in the default group, without
+// smoothing and in the default material: where the files before left a g, s or usemtl
+// record in effect, g default, s off or usemtl default goes before the first element,
+// unless the file sets that state itself. Files are read ahead on a background thread, up to
+// about bufferSize bytes of them; bigger files are streamed when their turn comes.
+bool mergeFiles(const std::vector<std::string>& paths, Sink& out, bool prefixNames, size_t bufferSize,
+	std::string& error, Report* report);
+
+} // namespace objmagic
@@ -0,0 +1,433 @@
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+
+#include "../glm/common.hpp"
+#include "mesh.hpp"
+#include "parse.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+inline bool startsWith(const char* row, size_t len, const char* prefix, size_t prefixLen) {
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+#define STARTS_WITH(row, len, prefix) startsWith(row, len, prefix, sizeof(prefix) - 1)
+
+RecordKind classify(const char* row, size_t len) {
+	if (len < 2) return RecordRaw;
+	switch (row[0]) {
+		case 'v':
+			if (row[1] == ' ') return RecordVertex;
+			if (STARTS_WITH(row, len, "vt ")) return RecordTexCoord;
+			if (STARTS_WITH(row, len, "vn ")) return RecordNormal;
+			break;
+		case 'f': if (row[1] == ' ') return RecordFace; break;
+		case 'l': if (row[1] == ' ') return RecordLine; break;
+		case 'p': if (row[1] == ' ') return RecordPoint; break;
+		case 'g': if (row[1] == ' ') return RecordGroup; break;
+		case 'o': if (row[1] == ' ') return RecordObject; break;
+		case 's': if (row[1] == ' ') return RecordSmoothing; break;
+		case 'u': if (STARTS_WITH(row, len, "usemtl ")) return RecordMaterial; break;
+	}
+	return RecordRaw;
+}
+
+// Number of index tuples in an f, l or p record
+size_t countTuples(const char* p, const char* end) {
+	size_t tuples = 0;
+	bool inTuple = false;
+	for (; p < end && *p != '#'; ++p) {
+		bool blank = *p == ' ' || *p == '\t';
+		if (!blank && !inTuple) ++tuples;
+		inTuple = !blank;
+	}
+	return tuples;
+}
+
+void writeIndex(Sink& out, Index index) {
+	char tmp[24];
+	char* p = tmp + sizeof(tmp);
+	uint64_t value = (uint64_t)index + 1;
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	out.write(p, tmp + sizeof(tmp) - p);
+}
+
+} // namespace
+
+
+bool Text::operator==(const Text& other) const {
+	return size == other.size && memcmp(data, other.data, size) == 0;
+}
+
+Elements::Elements(Arena* arena):
+	offsets(ArenaAllocator<Index>(arena)), v(ArenaAllocator<Index>(arena)),
+	vt(ArenaAllocator<Index>(arena)), vn(ArenaAllocator<Index>(arena)),
+	dirty(arena), relative(arena)
+{
+	offsets.push_back(0);
+}
+
+size_t Elements::bytes() const {
+	return (offsets.capacity() + v.capacity() + vt.capacity() + vn.capacity()) * sizeof(Index)
+		+ dirty.bytes() + relative.bytes();
+}
+
+Mesh::Mesh():
+	px(&arena), py(&arena), pz(&arena), tu(&arena), tv(&arena), nx(&arena), ny(&arena), nz(&arena),
+	vertexDirty(&arena), texCoordDirty(&arena), normalDirty(&arena),
+	faces(&arena), lines(&arena), points(&arena),
+	records(&arena), texts(&arena), materials(&arena), groups(&arena), objects(&arena)
+{}
+
+bool Mesh::load(Source& source, std::string& error) {
+	// Sizing pass
+	uint64_t lineCount = 0, textBytes = 0;
+	uint64_t counts[RecordSmoothing + 1] = {};
+	uint64_t corners[RecordSmoothing + 1] = {};
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		++lineCount;
+		RecordKind kind = classify(row, len);
+		++counts[kind];
+		if (kind == RecordFace || kind == RecordLine || kind == RecordPoint)
+			corners[kind] += countTuples(row + 2, row + len);
+		else if (kind != RecordVertex && kind != RecordTexCoord && kind != RecordNormal)
+			textBytes += len;
+	}
+	source.rewind();
+
+	uint64_t limit = NoIndex - 1;
+	if (counts[RecordVertex] > limit || counts[RecordTexCoord] > limit || counts[RecordNormal] > limit
+		|| corners[RecordFace] > limit || corners[RecordLine] > limit || corners[RecordPoint] > limit
+		|| lineCount - counts[RecordVertex] - counts[RecordTexCoord] - counts[RecordNormal] > limit) {
+		error = source.name() + " is too large for 32-bit indices, build with OBJMAGIC_64BIT_INDICES";
+		return false;
+	}
+
+	px.reserve(counts[RecordVertex]); py.reserve(counts[RecordVertex]); pz.reserve(counts[RecordVertex]);
+	tu.reserve(counts[RecordTexCoord]); tv.reserve(counts[RecordTexCoord]);
+	nx.reserve(counts[RecordNormal]); ny.reserve(counts[RecordNormal]); nz.reserve(counts[RecordNormal]);
+	vertexDirty.resize(counts[RecordVertex]);
+	texCoordDirty.resize(counts[RecordTexCoord]);
+	normalDirty.resize(counts[RecordNormal]);
+	Elements* lists[] = { &faces, &lines, &points };
+	RecordKind listKinds[] = { RecordFace, RecordLine, RecordPoint };
+	for (int i = 0; i < 3; ++i) {
+		lists[i]->offsets.reserve(counts[listKinds[i]] + 1);
+		lists[i]->v.reserve(corners[listKinds[i]]);
+		lists[i]->vt.reserve(corners[listKinds[i]]);
+		lists[i]->vn.reserve(corners[listKinds[i]]);
+		lists[i]->dirty.resize(counts[listKinds[i]]);
+		lists[i]->relative.resize(counts[listKinds[i]]);
+	}
+	records.reserve(lineCount);
+	texts.reserve(lineCount - counts[RecordVertex] - counts[RecordTexCoord] - counts[RecordNormal]
+		- counts[RecordFace] - counts[RecordLine] - counts[RecordPoint]);
+	char* textData = (char*)arena.allocate(textBytes + 1, 1);
+
+	// Filling pass
+	ElementCounts total;
+	total.v = counts[RecordVertex];
+	total.vt = counts[RecordTexCoord];
+	total.vn = counts[RecordNormal];
+	ElementCounts sofar;
+	std::vector<Index> tuples(3 * 64);
+	uint64_t line = 0;
+	while (source.readLine(row, len)) {
+		RecordKind kind = classify(row, len);
+		Record record = { line++, 0, kind };
+		float in[3] = { 0, 0, 0 };
+		switch (kind) {
+			case RecordVertex:
+				parseFloats(row + 2, in, 3);
+				record.index = px.size();
+				px.push_back(in[0]); py.push_back(in[1]); pz.push_back(in[2]);
+				++sofar.v;
+				break;
+			case RecordTexCoord:
+				parseFloats(row + 3, in, 2);
+				record.index = tu.size();
+				tu.push_back(in[0]); tv.push_back(in[1]);
+				++sofar.vt;
+				break;
+			case RecordNormal:
+				parseFloats(row + 3, in, 3);
+				record.index = nx.size();
+				nx.push_back(in[0]); ny.push_back(in[1]); nz.push_back(in[2]);
+				++sofar.vn;
+				break;
+			case RecordFace:
+			case RecordLine:
+			case RecordPoint: {
+				Elements& list = kind == RecordFace ? faces : kind == RecordLine ? lines : points;
+				int n = parseIndexTuples<Index>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+				if (n > (int)tuples.size() / 3) {
+					tuples.resize(3 * n);
+					n = parseIndexTuples<Index>(row + 2, row + len, sofar, &tuples[0], n);
+				}
+				if (n < 0) {
+					error = "Malformed element in " + source.name() + " line " + std::to_string(line);
+					return false;
+				}
+				record.index = list.size();
+				for (int i = 0; i < n; ++i) {
+					Index v = tuples[i * 3], vt = tuples[i * 3 + 1], vn = tuples[i * 3 + 2];
+					if (v >= total.v || (vt != NoIndex && vt >= total.vt) || (vn != NoIndex && vn >= total.vn)) {
+						error = "Index out of range in " + source.name() + " line " + std::to_string(line);
+						return false;
+					}
+					list.v.push_back(v);
+					list.vt.push_back(vt);
+					list.vn.push_back(vn);
+				}
+				list.offsets.push_back(list.v.size());
+				if (memchr(row + 2, '-', len - 2)) list.relative.set(record.index);
+				break;
+			}
+			default:
+				memcpy(textData, row, len);
+				record.index = texts.size();
+				texts.push_back(Text{ textData, (uint32_t)len });
+				textData += len;
+				break;
+		}
+		records.push_back(record);
+	}
+	source.rewind();
+	updateRanges();
+	return true;
+}
+
+void Mesh::updateRanges() {
+	materials.clear();
+	groups.clear();
+	objects.clear();
+	Text none = { "", 0 };
+	Text material = none, group = none, object = none;
+	Index face = 0;
+	auto extend = [&face](Array<Range>& ranges, const Text& name) {
+		if (!ranges.empty() && ranges.back().first + ranges.back().count == face && ranges.back().name == name)
+			++ranges.back().count;
+		else ranges.push_back(Range{ name, face, 1 });
+	};
+	for (const Record& record : records) {
+		switch (record.kind) {
+			case RecordMaterial: material = texts[record.index]; break;
+			case RecordGroup: group = texts[record.index]; break;
+			case RecordObject: object = texts[record.index]; break;
+			case RecordFace:
+				extend(materials, material);
+				extend(groups, group);
+				extend(objects, object);
+				++face;
+				break;
+			default: break;
+		}
+	}
+	// Strip the keywords, names are what matters
+	for (Range& range : materials) if (range.name.size >= 7) { range.name.data += 7; range.name.size -= 7; }
+	for (Range& range : groups) if (range.name.size >= 2) { range.name.data += 2; range.name.size -= 2; }
+	for (Range& range : objects) if (range.name.size >= 2) { range.name.data += 2; range.name.size -= 2; }
+}
+
+Array<Range> Mesh::faceRuns() const {
+	Array<Range> runs;
+	bool inRun = false;
+	for (const Record& record : records) {
+		if (record.kind != RecordFace) {
+			inRun = false;
+			continue;
+		}
+		if (inRun) ++runs.back().count;
+		else runs.push_back(Range{ Text{ "", 0 }, record.index, 1 });
+		inRun = true;
+	}
+	return runs;
+}
+
+void Mesh::permuteFaces(const Array<Index>& order) {
+	Elements result(&arena);
+	result.offsets.reserve(faces.offsets.size());
+	result.v.reserve(faces.v.size());
+	result.vt.reserve(faces.vt.size());
+	result.vn.reserve(faces.vn.size());
+	result.dirty.resize(faces.size());
+	result.relative.resize(faces.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		Index face = order[i];
+		for (Index c = faces.offsets[face]; c < faces.offsets[face + 1]; ++c) {
+			result.v.push_back(faces.v[c]);
+			result.vt.push_back(faces.vt[c]);
+			result.vn.push_back(faces.vn[c]);
+		}
+		result.offsets.push_back(result.v.size());
+		if (face != i || faces.dirty.test(face)) result.dirty.set(i);
+		if (faces.relative.test(face)) result.relative.set(i);
+	}
+	std::swap(faces, result);
+	updateRanges();
+}
+
+void Mesh::removeFaces(const Bitset& removed) {
+	Elements result(&arena);
+	size_t count = faces.size() - removed.count();
+	result.offsets.reserve(count + 1);
+	result.dirty.resize(count);
+	result.relative.resize(count);
+	Array<Record> kept((ArenaAllocator<Record>(&arena)));
+	kept.reserve(records.size() - (faces.size() - count));
+	for (const Record& record : records) {
+		if (record.kind != RecordFace) {
+			kept.push_back(record);
+			continue;
+		}
+		Index face = record.index;
+		if (removed.test(face)) continue;
+		Index i = result.size();
+		for (Index c = faces.offsets[face]; c < faces.offsets[face + 1]; ++c) {
+			result.v.push_back(faces.v[c]);
+			result.vt.push_back(faces.vt[c]);
+			result.vn.push_back(faces.vn[c]);
+		}
+		result.offsets.push_back(result.v.size());
+		if (faces.dirty.test(face)) result.dirty.set(i);
+		if (faces.relative.test(face)) result.relative.set(i);
+		kept.push_back(Record{ record.line, i, RecordFace });
+	}
+	std::swap(faces, result);
+	std::swap(records, kept);
+	updateRanges();
+}
+
+bool Mesh::write(Sink& out, Source* original) const {
+	uint64_t next = 0; // Next line to be read from the original
+	if (original && !original->rewind()) original = nullptr;
+	const char* row;
+	size_t len;
+
+	auto number = [&out](float value, bool dirty) {
+		if (dirty) out.number(value);
+		else out.exactNumber(value);
+	};
+	auto writeElement = [&](char keyword, const Elements& list, Index i) {
+		out.put(keyword);
+		for (Index c = list.offsets[i]; c < list.offsets[i + 1]; ++c) {
+			out.put(' ');
+			writeIndex(out, list.v[c]);
+			if (list.vt[c] != NoIndex) {
+				out.put('/');
+				writeIndex(out, list.vt[c]);
+				if (list.vn[c] != NoIndex) {
+					out.put('/');
+					writeIndex(out, list.vn[c]);
+				}
+			} else if (list.vn[c] != NoIndex) {
+				out.write("//", 2);
+				writeIndex(out, list.vn[c]);
+			}
+		}
+		out.put('\n');
+	};
+
+	for (const Record& record : records) {
+		bool dirty = false;
+		switch (record.kind) {
+			case RecordVertex: dirty = vertexDirty.test(record.index); break;
+			case RecordTexCoord: dirty = texCoordDirty.test(record.index); break;
+			case RecordNormal: dirty = normalDirty.test(record.index); break;
+			case RecordFace: dirty = faces.dirty.test(record.index) || (renumbered && faces.relative.test(record.index)); break;
+			case RecordLine: dirty = lines.dirty.test(record.index) || (renumbered && lines.relative.test(record.index)); break;
+			case RecordPoint: dirty = points.dirty.test(record.index) || (renumbered && points.relative.test(record.index)); break;
+			default: {
+				const Text& text = texts[record.index];
+				out.write(text.data, text.size);
+				out.put('\n');
+				continue;
+			}
+		}
+
+		if (!dirty && original && record.line != NoLine && record.line >= next) {
+			bool found = true;
+			while (next < record.line && (found = original->readLine(row, len))) ++next;
+			if (found && original->readLine(row, len)) {
+				++next;
+				out.write(row, len);
+				out.put('\n');
+				continue;
+			}
+			original = nullptr;
+		}
+
+		Index i = record.index;
+		switch (record.kind) {
+			case RecordVertex:
+				out.write("v ", 2);
+				number(px[i], dirty); out.put(' '); number(py[i], dirty); out.put(' '); number(pz[i], dirty);
+				out.put('\n');
+				break;
+			case RecordTexCoord:
+				out.write("vt ", 3);
+				number(tu[i], dirty); out.put(' '); number(tv[i], dirty);
+				out.put('\n');
+				break;
+			case RecordNormal:
+				out.write("vn ", 3);
+				number(nx[i], dirty); out.put(' '); number(ny[i], dirty); out.put(' '); number(nz[i], dirty);
+				out.put('\n');
+				break;
+			case RecordFace: writeElement('f', faces, i); break;
+			case RecordLine: writeElement('l', lines, i); break;
+			case RecordPoint: writeElement('p', points, i); break;
+			default: break;
+		}
+	}
+	out.flush();
+	return out.good();
+}
+
+Info Mesh::analyze() const {
+	Info info;
+	info.lbound = vec3(std::numeric_limits<float>::max());
+	info.ubound = vec3(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < px.size(); ++i) {
+		vec3 in(px[i], py[i], pz[i]);
+		info.lbound = min(in, info.lbound);
+		info.ubound = max(in, info.ubound);
+	}
+	info.vertices = vertexCount();
+	info.texcoords = texCoordCount();
+	info.normals = normalCount();
+	info.faces = faces.size();
+	info.lines = lines.size();
+	info.points = points.size();
+	for (const Record& record : records) {
+		if (record.kind == RecordObject) ++info.objects;
+		else if (record.kind == RecordMaterial) {
+			const Text& text = texts[record.index];
+			info.materials[std::string(text.data + 7, text.size - 7)]++;
+		}
+	}
+	return info;
+}
+
+Index Mesh::addText(const std::string& text) {
+	char* data = (char*)arena.allocate(text.size(), 1);
+	memcpy(data, text.data(), text.size());
+	texts.push_back(Text{ data, (uint32_t)text.size() });
+	return texts.size() - 1;
+}
+
+size_t Mesh::memoryUsage() const {
+	return sizeof(Mesh) + arena.bytesReserved();
+}
+
+} // namespace objmagic
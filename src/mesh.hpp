@@ -0,0 +1,131 @@
+#pragma once
+
+// In-memory indexed mesh for operations that need random access to the whole model.
+//
+// Attributes are kept as structure of arrays and faces, lines and points in CSR form
+// (corner ranges given by an offsets array), all allocated from the mesh's arena.
+// Every line of the source becomes a record, so the mesh can be written back with
+// untouched lines copied verbatim from the source and only modified elements reformatted.
+
+#include <string>
+#include <cstdint>
+
+#include "arena.hpp"
+#include "bitset.hpp"
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+#ifdef OBJMAGIC_64BIT_INDICES
+typedef uint64_t Index;
+#else
+typedef uint32_t Index;
+#endif
+
+static const Index NoIndex = ~Index(0);
+static const uint64_t NoLine = ~uint64_t(0);
+
+// String stored in the arena
+struct Text {
+	const char* data;
+	uint32_t size;
+
+	std::string str() const { return std::string(data, size); }
+	bool operator==(const Text& other) const;
+};
+
+enum RecordKind : uint8_t {
+	RecordRaw,       // Any line not listed below, e.g. comments and mtllib
+	RecordVertex,    // v
+	RecordTexCoord,  // vt
+	RecordNormal,    // vn
+	RecordFace,      // f
+	RecordLine,      // l
+	RecordPoint,     // p
+	RecordMaterial,  // usemtl
+	RecordGroup,     // g
+	RecordObject,    // o
+	RecordSmoothing  // s
+};
+
+// One output line: an element, or a text line for the non-element kinds
+struct Record {
+	uint64_t line;    // Line number in the source (0-based), NoLine for new records
+	Index index;      // Element index, or index into Mesh::texts
+	RecordKind kind;
+};
+
+// Faces, lines or points: corners of element i are [offsets[i], offsets[i + 1])
+struct Elements {
+	Array<Index> offsets;
+	Array<Index> v, vt, vn; // Per corner, 0-based, NoIndex if missing
+	Bitset dirty;           // Needs reformatting
+	Bitset relative;        // Written with negative indices in the source
+
+	explicit Elements(Arena* arena);
+	size_t size() const { return offsets.size() - 1; }
+	Index corners(size_t i) const { return offsets[i + 1] - offsets[i]; }
+	size_t bytes() const;
+};
+
+// Consecutive faces sharing a material, group or object name
+struct Range {
+	Text name;
+	Index first, count;
+};
+
+class Mesh {
+public:
+	Mesh();
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	// Reads the whole source in two passes: one to size the arrays exactly, one to fill them.
+	// Rewinds the source when done.
+	bool load(Source& source, std::string& error);
+
+	// Writes all records in order. Clean elements are copied from the original source
+	// (if given and still ahead of the read position), everything else is formatted:
+	// modified values like the streaming transforms do, moved ones with enough digits
+	// to restore the same float.
+	bool write(Sink& out, Source* original = nullptr) const;
+
+	Info analyze() const;
+	// Recomputes material, group and object ranges from the records
+	void updateRanges();
+	// Runs of faces whose records follow each other with nothing in between, so that they
+	// can be reordered without changing their material, group, object or smoothing group
+	Array<Range> faceRuns() const;
+	// Puts face order[i] in place i, marking moved faces for reformatting
+	void permuteFaces(const Array<Index>& order);
+	// Removes the faces set in removed and their records, renumbering the rest
+	void removeFaces(const Bitset& removed);
+	// Stores a line for a new text record in texts, returning its index there
+	Index addText(const std::string& text);
+	// Bytes of memory held by the mesh
+	size_t memoryUsage() const;
+
+	size_t vertexCount() const { return px.size(); }
+	size_t texCoordCount() const { return tu.size(); }
+	size_t normalCount() const { return nx.size(); }
+
+	Arena arena;
+
+	Array<float> px, py, pz;
+	Array<float> tu, tv;
+	Array<float> nx, ny, nz;
+	Bitset vertexDirty, texCoordDirty, normalDirty;
+
+	Elements faces, lines, points;
+
+	Array<Record> records; // Elements of each kind appear in index order
+	Array<Text> texts;
+
+	Array<Range> materials, groups, objects;
+
+	// Set when vertex, texture coordinate or normal records were removed or reordered,
+	// which invalidates relative indices in the source text
+	bool renumbered = false;
+};
+
+} // namespace objmagic
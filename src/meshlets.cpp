@@ -0,0 +1,333 @@
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "../glm/geometric.hpp"
+#include "meshlets.hpp"
+#include "vertexcache.hpp"
+#include "triangulate.hpp"
+#include "threadpool.hpp"
+#include "vecmath.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+std::string format(double value) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%.1f", value);
+	return tmp;
+}
+
+void append32(std::string& out, uint32_t value) {
+	const char bytes[4] = { char(value), char(value >> 8), char(value >> 16), char(value >> 24) };
+	out.append(bytes, 4);
+}
+
+void appendFloat(std::string& out, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	append32(out, bits);
+}
+
+// Meshlets of one run at a time. Vertex data is kept per render vertex and reset after
+// use, so runs can share it.
+struct Clusterer {
+	const Mesh& mesh;
+	const RenderVertices& vertices;
+	std::vector<Index> local;   // Render vertex to local vertex in the current run
+	std::vector<Index> globals; // Local vertex to one of its corners
+	std::vector<Index> triangles; // Three local vertices each
+	std::vector<Index> offsets;   // CSR of triangles around each local vertex
+	std::vector<Index> adjacent;
+	std::vector<std::pair<uint32_t, Index>> seeds; // Triangles in Z-order
+	std::vector<uint8_t> used;
+	std::vector<uint32_t> listed; // Meshlet number + 1 a triangle was last a candidate for
+	std::vector<int> slot;        // Local vertex to its place in the current meshlet, -1 if not in it
+	std::vector<Index> candidates;
+	std::vector<uint32_t> polygon;
+	std::vector<vec3> corners;
+
+	Clusterer(const Mesh& mesh, const RenderVertices& vertices):
+		mesh(mesh), vertices(vertices), local(vertices.count, NoIndex) {}
+
+	vec3 position(Index localVertex) const {
+		Index v = mesh.faces.v[globals[localVertex]];
+		return vec3(mesh.px[v], mesh.py[v], mesh.pz[v]);
+	}
+
+	vec3 centroid(Index triangle) const {
+		const Index* corners = &triangles[triangle * 3];
+		return (position(corners[0]) + position(corners[1]) + position(corners[2])) / 3.0f;
+	}
+
+	void run(const Range& range, uint32_t runIndex, Meshlets& out);
+	void finish(uint32_t runIndex, const std::vector<Index>& members, const std::vector<uint8_t>& micro, Meshlets& out);
+};
+
+void Clusterer::run(const Range& range, uint32_t runIndex, Meshlets& out) {
+	const Elements& faces = mesh.faces;
+	globals.clear();
+	triangles.clear();
+	for (Index f = range.first; f < range.first + range.count; ++f) {
+		Index first = faces.offsets[f], count = faces.corners(f);
+		if (count < 3) continue;
+		polygon.clear();
+		if (count == 3) {
+			polygon.insert(polygon.end(), { 0, 1, 2 });
+		} else {
+			corners.resize(count);
+			for (Index c = 0; c < count; ++c) {
+				Index v = faces.v[first + c];
+				corners[c] = vec3(mesh.px[v], mesh.py[v], mesh.pz[v]);
+			}
+			triangulatePolygon(&corners[0], count, polygon);
+		}
+		for (uint32_t corner : polygon) {
+			Index c = first + corner;
+			Index r = vertices.corners[c];
+			if (local[r] == NoIndex) {
+				local[r] = globals.size();
+				globals.push_back(c);
+			}
+			triangles.push_back(local[r]);
+		}
+	}
+	for (Index c : globals) local[vertices.corners[c]] = NoIndex;
+	size_t vertexCount = globals.size(), triangleCount = triangles.size() / 3;
+	if (!triangleCount) return;
+
+	offsets.assign(vertexCount + 1, 0);
+	for (Index v : triangles) ++offsets[v + 1];
+	for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] += offsets[v];
+	adjacent.resize(triangles.size());
+	for (size_t t = 0; t < triangles.size(); ++t)
+		adjacent[offsets[triangles[t]]++] = t / 3;
+	for (size_t v = vertexCount; v > 0; --v) offsets[v] = offsets[v - 1];
+	offsets[0] = 0;
+
+	vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+	for (size_t v = 0; v < vertexCount; ++v) {
+		lower = min(lower, position(v));
+		upper = max(upper, position(v));
+	}
+	vec3 extent = max(upper - lower, vec3(1e-30f));
+	seeds.resize(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		seeds[t] = std::make_pair(mortonCode((centroid(t) - lower) / extent), (Index)t);
+	}
+	std::sort(seeds.begin(), seeds.end());
+
+	used.assign(triangleCount, 0);
+	listed.assign(triangleCount, 0);
+	slot.assign(vertexCount, -1);
+	std::vector<Index> members; // Local vertices of the current meshlet
+	vec3 sum(0.0f);             // Of their positions
+	std::vector<uint8_t> micro;
+	candidates.clear();
+	size_t nextSeed = 0, left = triangleCount;
+	uint32_t number = 0;
+	auto fresh = [&](Index t) {
+		int count = 0;
+		for (int k = 0; k < 3; ++k) {
+			Index v = triangles[t * 3 + k];
+			bool repeated = (k > 0 && triangles[t * 3] == v) || (k > 1 && triangles[t * 3 + 1] == v);
+			if (slot[v] < 0 && !repeated) ++count;
+		}
+		return count;
+	};
+	auto emit = [&]() {
+		finish(runIndex, members, micro, out);
+		for (Index v : members) slot[v] = -1;
+		members.clear();
+		sum = vec3(0.0f);
+		micro.clear();
+		candidates.clear();
+		++number;
+	};
+	while (left) {
+		// The adjacent triangle adding the fewest vertices, then the one closest to the center
+		Index best = NoIndex;
+		int bestFresh = 4;
+		float bestDistance = 0.0f;
+		vec3 center = sum / float(std::max<size_t>(members.size(), 1));
+		for (size_t i = candidates.size(); i-- > 0 && bestFresh > 0;) {
+			Index t = candidates[i];
+			if (used[t]) {
+				candidates[i] = candidates.back();
+				candidates.pop_back();
+				continue;
+			}
+			int count = fresh(t);
+			if (count > bestFresh || members.size() + count > MESHLET_MAX_VERTICES) continue;
+			vec3 offset = centroid(t) - center;
+			float distance = dot(offset, offset);
+			if (count < bestFresh || distance < bestDistance) {
+				best = t;
+				bestFresh = count;
+				bestDistance = distance;
+			}
+		}
+		if (best == NoIndex && candidates.empty()) {
+			// Nothing adjacent left, go on from the next triangle in Z-order if it fits
+			while (used[seeds[nextSeed].second]) ++nextSeed;
+			Index t = seeds[nextSeed].second;
+			if (members.size() + fresh(t) <= MESHLET_MAX_VERTICES) best = t;
+		}
+		if (best == NoIndex) {
+			emit();
+			continue;
+		}
+
+		used[best] = 1;
+		--left;
+		for (int k = 0; k < 3; ++k) {
+			Index v = triangles[best * 3 + k];
+			if (slot[v] < 0) {
+				slot[v] = members.size();
+				members.push_back(v);
+				sum += position(v);
+				for (Index a = offsets[v]; a < offsets[v + 1]; ++a) {
+					Index t = adjacent[a];
+					if (used[t] || listed[t] == number + 1) continue;
+					listed[t] = number + 1;
+					candidates.push_back(t);
+				}
+			}
+			micro.push_back(slot[v]);
+		}
+		if (micro.size() == MESHLET_MAX_TRIANGLES * 3 || !left)
+			emit();
+	}
+}
+
+void Clusterer::finish(uint32_t runIndex, const std::vector<Index>& members, const std::vector<uint8_t>& micro, Meshlets& out) {
+	Meshlet meshlet;
+	meshlet.run = runIndex;
+	meshlet.vertexOffset = out.vertices.size() / 3;
+	meshlet.triangleOffset = out.triangles.size() / 3;
+	meshlet.vertexCount = members.size();
+	meshlet.triangleCount = micro.size() / 3;
+	const Elements& faces = mesh.faces;
+	vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+	for (Index v : members) {
+		Index c = globals[v];
+		out.vertices.push_back(faces.v[c]);
+		out.vertices.push_back(faces.vt[c] == NoIndex ? ~0u : (uint32_t)faces.vt[c]);
+		out.vertices.push_back(faces.vn[c] == NoIndex ? ~0u : (uint32_t)faces.vn[c]);
+		lower = min(lower, position(v));
+		upper = max(upper, position(v));
+	}
+	meshlet.center = (lower + upper) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (Index v : members)
+		meshlet.radius = std::max(meshlet.radius, distance(meshlet.center, position(v)));
+
+	// Cone around the unit normals of the triangles with an area
+	corners.clear();
+	vec3 sum(0.0f);
+	for (size_t t = 0; t < micro.size(); t += 3) {
+		vec3 a = position(members[micro[t]]), b = position(members[micro[t + 1]]), c = position(members[micro[t + 2]]);
+		vec3 normal = cross(b - a, c - a);
+		float length = glm::length(normal);
+		if (length == 0.0f) continue;
+		corners.push_back(normal / length);
+		sum += corners.back();
+	}
+	float length = glm::length(sum);
+	meshlet.axis = vec3(0.0f);
+	meshlet.cutoff = 1.0f;
+	if (length > 0.0f) {
+		meshlet.axis = sum / length;
+		float spread = 1.0f;
+		for (const vec3& normal : corners)
+			spread = std::min(spread, dot(normal, meshlet.axis));
+		if (spread > 0.0f) meshlet.cutoff = std::sqrt(1.0f - spread * spread);
+	}
+	out.triangles.insert(out.triangles.end(), micro.begin(), micro.end());
+	out.meshlets.push_back(meshlet);
+}
+
+} // namespace
+
+void buildMeshlets(const Mesh& mesh, Meshlets& result, ThreadPool& pool) {
+	RenderVertices vertices(mesh);
+	Array<Range> runs = mesh.faceRuns();
+	std::vector<Meshlets> perRun(runs.size());
+	parallelFor(pool, runs.size(), 1, [&](size_t begin, size_t end) {
+		Clusterer clusterer(mesh, vertices);
+		for (size_t i = begin; i < end; ++i)
+			clusterer.run(runs[i], i, perRun[i]);
+	});
+
+	result = Meshlets();
+	for (Meshlets& part : perRun) {
+		for (Meshlet meshlet : part.meshlets) {
+			meshlet.vertexOffset += result.vertices.size() / 3;
+			meshlet.triangleOffset += result.triangles.size() / 3;
+			result.meshlets.push_back(meshlet);
+		}
+		result.vertices.insert(result.vertices.end(), part.vertices.begin(), part.vertices.end());
+		result.triangles.insert(result.triangles.end(), part.triangles.begin(), part.triangles.end());
+		part = Meshlets();
+	}
+}
+
+bool writeMeshlets(const Meshlets& meshlets, const std::string& path, std::string& error) {
+	std::string data("OMML", 4);
+	append32(data, 1);
+	append32(data, meshlets.meshlets.size());
+	append32(data, meshlets.vertices.size() / 3);
+	append32(data, meshlets.triangles.size() / 3);
+	for (const Meshlet& meshlet : meshlets.meshlets) {
+		append32(data, meshlet.vertexOffset);
+		append32(data, meshlet.triangleOffset);
+		append32(data, meshlet.run);
+		append32(data, meshlet.vertexCount | uint32_t(meshlet.triangleCount) << 8);
+		for (int k = 0; k < 3; ++k) appendFloat(data, meshlet.center[k]);
+		appendFloat(data, meshlet.radius);
+		for (int k = 0; k < 3; ++k) appendFloat(data, meshlet.axis[k]);
+		appendFloat(data, meshlet.cutoff);
+	}
+	for (uint32_t index : meshlets.vertices)
+		append32(data, index);
+	data.append((const char*)meshlets.triangles.data(), meshlets.triangles.size());
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		error = "Failed to open file " + path + " for output";
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	if (fclose(file) != 0 || !ok) {
+		error = "Failed to write " + path;
+		return false;
+	}
+	return true;
+}
+
+bool exportMeshlets(const Mesh& mesh, const std::string& path, ThreadPool& pool, std::string& error, Report* report) {
+	Meshlets meshlets;
+	buildMeshlets(mesh, meshlets, pool);
+	if (!writeMeshlets(meshlets, path, error))
+		return false;
+	if (report) {
+		size_t count = meshlets.meshlets.size(), culled = 0;
+		for (const Meshlet& meshlet : meshlets.meshlets)
+			if (meshlet.cutoff < 1.0f) ++culled;
+		double divisor = std::max<size_t>(count, 1);
+		report->add("Meshlets", count);
+		report->add("Avg vertices", format(meshlets.vertices.size() / 3 / divisor));
+		report->add("Avg triangles", format(meshlets.triangles.size() / 3 / divisor));
+		report->add("Cullable", std::to_string(culled) + " (" + format(100.0 * culled / divisor) + "%)");
+		report->add("Meshlet bytes", 20 + 48 * count + 12 * meshlets.vertices.size() / 3 + meshlets.triangles.size());
+	}
+	return true;
+}
+
+} // namespace objmagic
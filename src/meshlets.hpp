@@ -0,0 +1,61 @@
+#pragma once
+
+// Small clusters of triangles with bounds for culling on the CPU, written to a binary file
+// beside the model.
+//
+// The file is little-endian and made of four consecutive parts:
+//   Header   "OMML", then uint32 version (1), meshlet count, vertex count and triangle count
+//   Meshlets 48 bytes each:
+//              uint32 first vertex, uint32 first triangle, uint32 run of faces (see
+//              Mesh::faceRuns, in file order), uint8 vertex count, uint8 triangle count,
+//              uint16 zero, float center[3], float radius, float axis[3], float cutoff
+//   Vertices 12 bytes each: uint32 v, vt and vn index (0-based, 0xffffffff if missing)
+//   Triangles 3 bytes each: the meshlet vertices of the corners, counted from its first one
+//
+// Center and radius bound the positions of the meshlet. Axis and cutoff bound its triangle
+// normals, so that it faces entirely away from a camera at position eye if
+//   dot(center - eye, axis) >= cutoff * length(center - eye) + radius
+// A cutoff of 1 means that the normals spread too much for the test to ever pass.
+
+#include <string>
+#include <vector>
+
+#include "../glm/vec3.hpp"
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+namespace objmagic {
+
+struct Meshlet {
+	uint32_t vertexOffset, triangleOffset;
+	uint32_t run;
+	uint8_t vertexCount, triangleCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 axis;
+	float cutoff;
+};
+
+struct Meshlets {
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> vertices; // v, vt and vn of each meshlet vertex
+	std::vector<uint8_t> triangles; // Three meshlet vertices per triangle
+};
+
+// Clusters the faces of every run of faces into meshlets of at most MESHLET_MAX_VERTICES
+// distinct (v, vt, vn) tuples and MESHLET_MAX_TRIANGLES triangles, splitting polygons like
+// --triangulate does. A meshlet grows by the adjacent triangle adding the fewest vertices to
+// it, and starts from the next unused triangle in Z-order once no adjacent one fits, so that
+// meshlets are small and round. Runs are clustered in parallel.
+void buildMeshlets(const Mesh& mesh, Meshlets& result, ThreadPool& pool);
+
+// Writes the meshlets in the format described above
+bool writeMeshlets(const Meshlets& meshlets, const std::string& path, std::string& error);
+
+// Builds the meshlets of the mesh, writes them to path and adds a summary to the report
+bool exportMeshlets(const Mesh& mesh, const std::string& path, ThreadPool& pool, std::string& error, Report* report);
+
+} // namespace objmagic
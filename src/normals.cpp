@@ -0,0 +1,174 @@
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+
+#include "../glm/geometric.hpp"
+#include "../glm/trigonometric.hpp"
+#include "normals.hpp"
+#include "dedupe.hpp"
+#include "threadpool.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+const int64_t FlatGroup = 0;
+const int64_t DefaultGroup = -1;
+
+// Smoothing group of an s record: 0 for off, the number or a hash of the name otherwise
+int64_t smoothingGroup(const Text& text) {
+	std::string name(text.data + 2, text.size - 2);
+	name.erase(0, name.find_first_not_of(" \t"));
+	name.erase(name.find_last_not_of(" \t") + 1);
+	if (name == "off" || name.empty()) return FlatGroup;
+	char* end;
+	long long number = strtoll(name.c_str(), &end, 10);
+	if (*end == '\0') return number;
+	return (int64_t)(std::hash<std::string>()(name) | (1ull << 62));
+}
+
+} // namespace
+
+void generateNormals(Mesh& mesh, NormalMode mode, float creaseAngle, ThreadPool& pool, Report* report) {
+	const Elements& faces = mesh.faces;
+	size_t faceCount = faces.size();
+	size_t cornerCount = faces.v.size();
+	if (!faceCount) {
+		if (report) report->add("Normals", 0);
+		return;
+	}
+	auto position = [&mesh](Index v) { return vec3(mesh.px[v], mesh.py[v], mesh.pz[v]); };
+
+	std::vector<int64_t> groups(faceCount, DefaultGroup);
+	{
+		int64_t group = DefaultGroup;
+		for (const Record& record : mesh.records) {
+			if (record.kind == RecordSmoothing) group = smoothingGroup(mesh.texts[record.index]);
+			else if (record.kind == RecordFace) groups[record.index] = group;
+		}
+	}
+
+	// Unit face normals, and corner weights of face area times corner angle
+	std::vector<vec3> faceNormals(faceCount);
+	std::vector<float> weights(cornerCount);
+	std::vector<Index> cornerFaces(cornerCount);
+	parallelFor(pool, faceCount, 1 << 14, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; ++f) {
+			Index first = faces.offsets[f], count = faces.corners(f);
+			vec3 normal(0.0f);
+			for (Index c = 0; c < count; ++c) {
+				vec3 a = position(faces.v[first + c]);
+				vec3 b = position(faces.v[first + (c + 1) % count]);
+				normal += vec3((a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y));
+			}
+			float area = length(normal) * 0.5f;
+			faceNormals[f] = area > 0.0f ? normal / (2.0f * area) : vec3(0.0f);
+			for (Index c = 0; c < count; ++c) {
+				vec3 p = position(faces.v[first + c]);
+				vec3 prev = position(faces.v[first + (c + count - 1) % count]) - p;
+				vec3 next = position(faces.v[first + (c + 1) % count]) - p;
+				float lengths = length(prev) * length(next);
+				float angle = lengths > 0.0f ? std::acos(clamp(dot(prev, next) / lengths, -1.0f, 1.0f)) : 0.0f;
+				weights[first + c] = area * angle;
+				cornerFaces[first + c] = f;
+			}
+		}
+	});
+
+	// Corners around each vertex in CSR form, in corner order
+	size_t vertexCount = mesh.vertexCount();
+	std::vector<Index> offsets(vertexCount + 1);
+	for (size_t c = 0; c < cornerCount; ++c)
+		++offsets[faces.v[c] + 1];
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] += offsets[v];
+	std::vector<Index> adjacent(cornerCount);
+	{
+		std::vector<Index> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t c = 0; c < cornerCount; ++c)
+			adjacent[fill[faces.v[c]]++] = c;
+	}
+
+	// Normal of each corner. Every corner sums its neighbors in a fixed order on
+	// a single thread, so results don't depend on the thread count.
+	float minDot = std::cos(radians(creaseAngle));
+	Array<float> nx(cornerCount), ny(cornerCount), nz(cornerCount);
+	parallelFor(pool, faceCount, 1 << 14, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; ++f) {
+			const vec3& own = faceNormals[f];
+			for (Index c = faces.offsets[f]; c < faces.offsets[f + 1]; ++c) {
+				vec3 normal = own;
+				if (mode != NormalsFlat && groups[f] != FlatGroup) {
+					normal = vec3(0.0f);
+					Index v = faces.v[c];
+					for (Index a = offsets[v]; a < offsets[v + 1]; ++a) {
+						Index g = cornerFaces[adjacent[a]];
+						if (groups[g] != groups[f]) continue;
+						if (mode == NormalsAuto && dot(faceNormals[g], own) < minDot) continue;
+						normal += faceNormals[g] * weights[adjacent[a]];
+					}
+					float len = length(normal);
+					normal = len > 0.0f ? normal / len : own;
+				}
+				if (normal == vec3(0.0f)) normal = vec3(0.0f, 0.0f, 1.0f);
+				nx[c] = normal.x;
+				ny[c] = normal.y;
+				nz[c] = normal.z;
+			}
+		}
+	});
+
+	// Corners with equal normals share a vn record
+	const Array<float>* const columns[] = { &nx, &ny, &nz };
+	Array<Index> first;
+	firstOccurrences(columns, 3, first, pool);
+	std::vector<Index> normalOf(cornerCount);
+	mesh.nx.clear(); mesh.ny.clear(); mesh.nz.clear();
+	for (size_t c = 0; c < cornerCount; ++c) {
+		if (first[c] == c) {
+			normalOf[c] = mesh.nx.size();
+			mesh.nx.push_back(nx[c]);
+			mesh.ny.push_back(ny[c]);
+			mesh.nz.push_back(nz[c]);
+		} else normalOf[c] = normalOf[first[c]];
+		mesh.faces.vn[c] = normalOf[c];
+	}
+	mesh.normalDirty.resize(0);
+	mesh.normalDirty.resize(mesh.nx.size());
+	for (size_t i = 0; i < mesh.nx.size(); ++i)
+		mesh.normalDirty.set(i);
+	for (size_t f = 0; f < faceCount; ++f)
+		mesh.faces.dirty.set(f);
+	Elements* const others[] = { &mesh.lines, &mesh.points };
+	for (Elements* list : others) {
+		for (size_t i = 0; i < list->size(); ++i) {
+			for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+				if (list->vn[c] == NoIndex) continue;
+				list->vn[c] = NoIndex;
+				list->dirty.set(i);
+			}
+		}
+	}
+
+	// New vn records go right before the first face, replacing the old ones
+	Array<Record> records(ArenaAllocator<Record>(&mesh.arena));
+	records.reserve(mesh.records.size() + mesh.nx.size());
+	bool inserted = false;
+	for (const Record& record : mesh.records) {
+		if (record.kind == RecordNormal) continue;
+		if (record.kind == RecordFace && !inserted) {
+			for (size_t i = 0; i < mesh.nx.size(); ++i)
+				records.push_back(Record{ NoLine, (Index)i, RecordNormal });
+			inserted = true;
+		}
+		records.push_back(record);
+	}
+	std::swap(mesh.records, records);
+	mesh.renumbered = true;
+	if (report) report->add("Normals", mesh.nx.size());
+}
+
+} // namespace objmagic
@@ -0,0 +1,17 @@
+#pragma once
+
+// Generation of vertex normals from the faces
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Replaces all normals with generated ones, shared by corners that end up with the same normal.
+// Flat gives each face its own normal. Smooth averages the normals of the faces around each
+// vertex, weighted by face area and corner angle, and Auto only averages faces whose normals
+// are within creaseAngle degrees of each other. Faces only smooth with faces of the same
+// smoothing group (s records), s off or s 0 makes them flat.
+void generateNormals(Mesh& mesh, NormalMode mode, float creaseAngle, ThreadPool& pool, Report* report);
+
+} // namespace objmagic
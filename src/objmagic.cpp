@@ -0,0 +1,806 @@
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+
+#include "../glm/mat4x4.hpp"
+#include "../glm/gtc/matrix_transform.hpp"
+#include "../glm/gtx/component_wise.hpp"
+#include "objmagic.hpp"
+#include "mesh.hpp"
+#include "clean.hpp"
+#include "dedupe.hpp"
+#include "weld.hpp"
+#include "triangulate.hpp"
+#include "normals.hpp"
+#include "vertexcache.hpp"
+#include "overdraw.hpp"
+#include "vertexfetch.hpp"
+#include "simplify.hpp"
+#include "lod.hpp"
+#include "decimate.hpp"
+#include "redundant.hpp"
+#include "chunks.hpp"
+#include "meshlets.hpp"
+#include "materials.hpp"
+#include "filter.hpp"
+#include "parse.hpp"
+#include "args.hpp"
+#include "threadpool.hpp"
+
+#define W 12
+#define SOURCE_BLOCK (1 << 20)
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+std::string toString(vec3 vec) {
+	std::ostringstream oss;
+	oss << std::right << std::setw(W) << vec.x << std::setw(W) << vec.y << std::setw(W) << vec.z;
+	return oss.str();
+}
+
+inline bool startsWith(const char* row, size_t len, const char* prefix, size_t prefixLen) {
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+#define STARTS_WITH(row, len, prefix) startsWith(row, len, prefix, sizeof(prefix) - 1)
+
+// Per-element transformations of the options, with analysis dependent parts resolved
+struct Transform {
+	const Options& options;
+	vec3 center;
+	vec3 scale;
+
+	Transform(const Options& options, const Info* info): options(options), scale(options.scale) {
+		if (!info) return;
+		center = options.center * info->center();
+		vec3 size = info->size();
+		const vec3& fit = options.fit;
+		if (fit.length()) {
+			float fitScale = 1.f;
+			if (options.fitUniform) fitScale = fit.x / compMax(size);
+			else if (fit.x) fitScale = fit.x / size.x;
+			else if (fit.y) fitScale = fit.y / size.y;
+			else if (fit.z) fitScale = fit.z / size.z;
+			scale *= fitScale;
+		}
+		const vec3& resize = options.resize;
+		if (resize.length()) {
+			vec3 resizeScale(1, 1, 1);
+			if (resize.x) resizeScale.x = resize.x / size.x;
+			if (resize.y) resizeScale.y = resize.y / size.y;
+			if (resize.z) resizeScale.z = resize.z / size.z;
+			scale *= resizeScale;
+		}
+	}
+
+	vec3 vertex(vec3 in) const {
+		in -= center;
+		in *= options.mirror;
+		in *= scale;
+		in = options.rotation * in;
+		in += options.translate;
+		return in;
+	}
+
+	vec3 texCoord(vec3 in) const {
+		if (options.flipUvX) in.x = 1.0f - in.x;
+		if (options.flipUvY) in.y = 1.0f - in.y;
+		in.x *= options.scaleUv.x;
+		in.y *= options.scaleUv.y;
+		return in;
+	}
+
+	vec3 normal(vec3 in) const {
+		in *= options.normalScale;
+		if (options.normalizeNormals) in = normalize(in);
+		return in;
+	}
+};
+
+// Applies the transformations to the mesh, marking changed elements for reformatting
+void transformMesh(Mesh& mesh, const Transform& transform) {
+	for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+		vec3 in(mesh.px[i], mesh.py[i], mesh.pz[i]);
+		vec3 out = transform.vertex(in);
+		if (out == in) continue;
+		mesh.px[i] = out.x; mesh.py[i] = out.y; mesh.pz[i] = out.z;
+		mesh.vertexDirty.set(i);
+	}
+	for (size_t i = 0; i < mesh.texCoordCount(); ++i) {
+		vec3 in(mesh.tu[i], mesh.tv[i], 0.0f);
+		vec3 out = transform.texCoord(in);
+		if (out == in) continue;
+		mesh.tu[i] = out.x; mesh.tv[i] = out.y;
+		mesh.texCoordDirty.set(i);
+	}
+	for (size_t i = 0; i < mesh.normalCount(); ++i) {
+		vec3 in(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+		vec3 out = transform.normal(in);
+		if (out == in) continue;
+		mesh.nx[i] = out.x; mesh.ny[i] = out.y; mesh.nz[i] = out.z;
+		mesh.normalDirty.set(i);
+	}
+}
+
+// Whole-mesh path: load, transform, run the operations and write back
+bool processMesh(Source& source, Sink& out, const Options& options, std::string& error, const Info* info, Report* report) {
+	std::unique_ptr<ThreadPool> ownPool(options.pool ? nullptr : new ThreadPool);
+	ThreadPool& pool = options.pool ? *options.pool : *ownPool;
+	Mesh mesh;
+	if (!mesh.load(source, error))
+		return false;
+	Info analyzed;
+	if (options.needsAnalysis() && !info) {
+		analyzed = mesh.analyze();
+		info = &analyzed;
+	}
+	if (options.dedupe)
+		dedupe(mesh, pool, report);
+	if (options.weld > 0.0f)
+		weld(mesh, options.weld, options.keepSeams, pool, report);
+	if (options.triangulate)
+		objmagic::triangulate(mesh, report);
+	if (options.simplify > 0.0)
+		objmagic::simplify(mesh, options.simplify, pool, report);
+	if (!options.lodChain.empty())
+		buildLodChain(mesh, options.lodChain, options.lodName, pool, report);
+	// After simplifying, which leaves vertices unused
+	if (options.clean)
+		removeUnreferenced(mesh, report);
+	if (options.optimizeVertexCache)
+		objmagic::optimizeVertexCache(mesh, report);
+	if (options.overdrawThreshold > 0.0f)
+		optimizeOverdraw(mesh, options.overdrawThreshold, report);
+	if (options.optimizeVertexFetch)
+		objmagic::optimizeVertexFetch(mesh, report);
+	Transform transform(options, options.needsAnalysis() ? info : nullptr);
+	transformMesh(mesh, transform);
+	// Normals are generated for the final positions, then inverted or normalized as requested
+	if (options.normals != NormalsKeep) {
+		generateNormals(mesh, options.normals, options.creaseAngle, pool, report);
+		for (size_t i = 0; i < mesh.normalCount(); ++i) {
+			vec3 normal = transform.normal(vec3(mesh.nx[i], mesh.ny[i], mesh.nz[i]));
+			mesh.nx[i] = normal.x; mesh.ny[i] = normal.y; mesh.nz[i] = normal.z;
+		}
+	}
+	// Last, as it keeps the attributes of each chunk to itself
+	if (options.maxVertices)
+		limitVertices(mesh, options.maxVertices, report);
+	if (!options.meshletFile.empty() && !exportMeshlets(mesh, options.meshletFile, pool, error, report))
+		return false;
+
+	if (report) {
+		std::ostringstream oss;
+		oss << mesh.memoryUsage() << " bytes (" << std::fixed << std::setprecision(1)
+			<< 100.0 * mesh.memoryUsage() / std::max<uint64_t>(source.size(), 1) << "% of input)";
+		report->add("Mesh memory", oss.str());
+	}
+	if (!mesh.write(out, &source)) {
+		error = "Failed to write output for " + source.name();
+		return false;
+	}
+	if (options.dedupe && report)
+		report->add("Bytes removed", (int64_t)source.size() - (int64_t)out.written());
+	return true;
+}
+
+// Regrouping by material streams over the result of the other operations
+bool processRegroup(Source& source, Sink& out, const Options& options, std::string& error, const Info* info, Report* report) {
+	Options rest = options;
+	rest.optimizeMaterials = false;
+	if (!rest.changesMesh())
+		return optimizeMaterials(source, out, options.bufferSize, error, report);
+	Source intermediate;
+	return processToTemp(source, intermediate, rest, error, info, report)
+		&& optimizeMaterials(intermediate, out, options.bufferSize, error, report);
+}
+
+// Clustering streams over the source, the other operations work on its result
+bool processDecimate(Source& source, Sink& out, const Options& options, std::string& error, const Info* info, Report* report) {
+	Options rest = options;
+	rest.clusterDecimate = 0.0f;
+	std::unique_ptr<ThreadPool> ownPool(options.pool ? nullptr : new ThreadPool);
+	ThreadPool& pool = options.pool ? *options.pool : *ownPool;
+	Info analyzed;
+	if (!info) {
+		analyzed = analyze(source);
+		info = &analyzed;
+	}
+	if (!rest.changesMesh())
+		return clusterDecimate(source, out, *info, options.clusterDecimate, pool, error, report);
+	Source intermediate;
+	return writeToTemp([&](Sink& sink) { return clusterDecimate(source, sink, *info, options.clusterDecimate, pool, error, report); },
+		intermediate, error) && process(intermediate, out, rest, error, nullptr, report);
+}
+
+// Removing faces streams over the source, the other operations work on its result, which
+// has the same vertices and so the same bounds
+bool processRemoveFaces(Source& source, Sink& out, const Options& options, std::string& error, const Info* info, Report* report) {
+	Options rest = options;
+	rest.removeDegenerate = rest.removeDuplicateFaces = false;
+	if (!rest.changesMesh())
+		return removeRedundantFaces(source, &out, options, error, report);
+	Source intermediate;
+	return writeToTemp([&](Sink& sink) { return removeRedundantFaces(source, &sink, options, error, report); },
+		intermediate, error) && process(intermediate, out, rest, error, info, report);
+}
+
+// Deleting comes first when the other operations look at the whole mesh
+bool processDeleteFirst(Source& source, Sink& out, const Options& options, std::string& error, Report* report) {
+	Options first, rest = options;
+	first.deleteMaterials.swap(rest.deleteMaterials);
+	first.deleteGroups.swap(rest.deleteGroups);
+	first.deleteObjects.swap(rest.deleteObjects);
+	Source filtered;
+	return processToTemp(source, filtered, first, error, nullptr, report)
+		&& process(filtered, out, rest, error, nullptr, report);
+}
+
+} // namespace
+
+
+bool Options::parse(const std::vector<std::string>& params, std::string& error) {
+	Args args(params);
+
+	info = args.opt('i', "info");
+	normalizeNormals = args.opt('n', "normalize-normals");
+	normalScale = args.opt(' ', "invert-normals") ? vec3(-1.0f) : vec3(1.0);
+
+	scale = vec3(args.arg('s', "scale", 1.0f));
+	scale.x *= args.arg(' ', "scalex", 1.0f);
+	scale.y *= args.arg(' ', "scaley", 1.0f);
+	scale.z *= args.arg(' ', "scalez", 1.0f);
+
+	scaleUv = vec2(args.arg(' ', "scaleuv", 1.0f));
+	scaleUv.x *= args.arg(' ', "scaleuvx", 1.0f);
+	scaleUv.y *= args.arg(' ', "scaleuvy", 1.0f);
+
+	flipUvX = args.opt(' ', "invertuv") || args.opt(' ', "invertuvx");
+	flipUvY = args.opt(' ', "invertuv") || args.opt(' ', "invertuvy");
+
+	translate = vec3(args.arg(' ', "translate", 0.0f));
+	translate.x += args.arg(' ', "translatex", 0.0f);
+	translate.y += args.arg(' ', "translatey", 0.0f);
+	translate.z += args.arg(' ', "translatez", 0.0f);
+
+	center = vec3();
+	if (args.opt('c', "center"))  center = vec3(1);
+	if (args.opt(' ', "centerx")) center.x = 1;
+	if (args.opt(' ', "centery")) center.y = 1;
+	if (args.opt(' ', "centerz")) center.z = 1;
+
+	mirror = ivec3(1);
+	if (args.opt(' ', "mirror"))  mirror = ivec3(-1);
+	if (args.opt(' ', "mirrorx")) mirror.x = -1;
+	if (args.opt(' ', "mirrory")) mirror.y = -1;
+	if (args.opt(' ', "mirrorz")) mirror.z = -1;
+
+	fit.x = args.arg(' ', "fitx", 0.0f);
+	fit.y = args.arg(' ', "fity", 0.0f);
+	fit.z = args.arg(' ', "fitz", 0.0f);
+	fitUniform = args.arg(' ', "fit", 0.0f) != 0.0f;
+	if (fitUniform)
+		fit = vec3(args.arg(' ', "fit", 0.0f));
+
+	resize.x = args.arg(' ', "resizex", 0.0f);
+	resize.y = args.arg(' ', "resizey", 0.0f);
+	resize.z = args.arg(' ', "resizez", 0.0f);
+	if (args.arg(' ', "resize", 0.0f))
+		resize = vec3(args.arg(' ', "resize", 0.0f));
+
+	vec3 rotangles(args.arg(' ', "rotate", 0.0f));
+	rotangles.x += args.arg(' ', "rotatex", 0.0f);
+	rotangles.y += args.arg(' ', "rotatey", 0.0f);
+	rotangles.z += args.arg(' ', "rotatez", 0.0f);
+	mat4 temprot(1.0f);
+	if (rotangles.x != 0.0f) temprot = glm::rotate(temprot, rotangles.x, vec3(1,0,0));
+	if (rotangles.y != 0.0f) temprot = glm::rotate(temprot, rotangles.y, vec3(0,1,0));
+	if (rotangles.z != 0.0f) temprot = glm::rotate(temprot, rotangles.z, vec3(0,0,1));
+	rotation = mat3(temprot);
+
+	clean = args.opt(' ', "clean");
+	dedupe = args.opt(' ', "dedupe");
+	weld = args.arg(' ', "weld", 0.0f);
+	keepSeams = args.opt(' ', "keep-seams");
+	triangulate = args.opt(' ', "triangulate");
+	optimizeVertexCache = args.opt(' ', "optimize-vertex-cache");
+	optimizeVertexFetch = args.opt(' ', "optimize-vertex-fetch");
+	if (args.opt(' ', "simplify")) {
+		simplify = args.arg(' ', "simplify", 0.0);
+		if (simplify <= 0.0 || (simplify > 1.0 && simplify != std::floor(simplify))) {
+			error = "Simplify target must be a ratio up to 1 or a triangle count";
+			return false;
+		}
+	}
+	removeDegenerate = args.opt(' ', "remove-degenerate");
+	degenerateArea = args.arg(' ', "remove-degenerate", 0.0f);
+	if (degenerateArea < 0.0f) {
+		error = "Degenerate face area can't be negative";
+		return false;
+	}
+	removeDuplicateFaces = args.opt(' ', "remove-duplicate-faces");
+	if (args.opt(' ', "cluster-decimate")) {
+		clusterDecimate = args.arg(' ', "cluster-decimate", 0.0f);
+		if (clusterDecimate <= 0.0f) {
+			error = "Cell size must be positive";
+			return false;
+		}
+	}
+	if (args.opt(' ', "lod-chain")) {
+		std::istringstream list(args.arg<std::string>(' ', "lod-chain"));
+		std::string item;
+		double previous = 1.0;
+		while (getline(list, item, ',')) {
+			char* end;
+			double ratio = strtod(item.c_str(), &end);
+			if (item.empty() || *end || ratio <= 0.0 || ratio > previous) {
+				lodChain.clear();
+				break;
+			}
+			lodChain.push_back(ratio);
+			previous = ratio;
+		}
+		if (lodChain.empty()) {
+			error = "LOD ratios must be decreasing fractions up to 1, separated by commas";
+			return false;
+		}
+	}
+	deleteMaterials = args.all(' ', "delete-material");
+	deleteGroups = args.all(' ', "delete-group");
+	deleteObjects = args.all(' ', "delete-object");
+	if ((args.opt(' ', "delete-material") && deleteMaterials.empty()) || (args.opt(' ', "delete-group") && deleteGroups.empty())
+		|| (args.opt(' ', "delete-object") && deleteObjects.empty())) {
+		error = "Missing name to delete";
+		return false;
+	}
+	if (args.opt(' ', "split-by")) {
+		std::string mode = args.arg<std::string>(' ', "split-by");
+		if (mode == "object") splitBy = SplitObject;
+		else if (mode == "group") splitBy = SplitGroup;
+		else if (mode == "material") splitBy = SplitMaterial;
+		else {
+			error = "Split mode must be object, group or material";
+			return false;
+		}
+	}
+	if (args.opt(' ', "max-vertices")) {
+		long long limit = args.arg(' ', "max-vertices", 0ll);
+		if (limit < 3) {
+			error = "Vertex limit must be at least 3";
+			return false;
+		}
+		maxVertices = limit;
+	}
+	if (args.opt(' ', "meshlets")) {
+		meshletFile = args.arg<std::string>(' ', "meshlets");
+		if (meshletFile.empty()) {
+			error = "Missing file name for meshlets";
+			return false;
+		}
+	}
+	lodFiles = args.opt(' ', "lod-files");
+	if (lodFiles && lodChain.empty()) {
+		error = "--lod-files needs --lod-chain";
+		return false;
+	}
+	if (lodFiles && splitBy != SplitNone) {
+		error = "Can't use --lod-files with --split-by";
+		return false;
+	}
+	merge = args.opt(' ', "merge");
+	prefixNames = args.opt(' ', "prefix-names");
+	optimizeMaterials = args.opt(' ', "optimize-materials");
+	float bufferMegabytes = args.arg(' ', "buffer-size", bufferSize / float(1 << 20));
+	if (bufferMegabytes <= 0.0f) {
+		error = "Buffer size must be positive";
+		return false;
+	}
+	bufferSize = bufferMegabytes * (1 << 20);
+	if (args.opt(' ', "optimize-overdraw")) {
+		overdrawThreshold = args.arg(' ', "optimize-overdraw", 1.05f);
+		if (overdrawThreshold < 1.0f) {
+			error = "Overdraw threshold must be at least 1";
+			return false;
+		}
+	}
+
+	if (args.opt(' ', "flat-normals")) normals = NormalsFlat;
+	if (args.opt(' ', "smooth-normals")) normals = NormalsSmooth;
+	if (args.opt(' ', "auto-normals")) {
+		normals = NormalsAuto;
+		creaseAngle = args.arg(' ', "auto-normals", creaseAngle);
+	}
+	if (weld < 0.0f) {
+		error = "Weld tolerance can't be negative";
+		return false;
+	}
+	indexed = args.opt(' ', "indexed");
+
+	return true;
+}
+
+bool Options::needsAnalysis() const {
+	return info || center != vec3(0.0f) || fit != vec3(0.0f) || resize != vec3(0.0f) || clusterDecimate > 0.0f;
+}
+
+bool Options::changesMesh() const {
+	return needsMesh() || deletes() || removesFaces() || clusterDecimate > 0.0f || clean || triangulate || normalizeNormals || normalScale != vec3(1.0f)
+		|| scale != vec3(1.0f) || scaleUv != vec2(1.0f) || flipUvX || flipUvY || translate != vec3(0.0f)
+		|| center != vec3(0.0f) || mirror != ivec3(1) || fit != vec3(0.0f) || resize != vec3(0.0f)
+		|| rotation != mat3(1.0f);
+}
+
+bool Options::needsMesh() const {
+	return indexed || dedupe || weld > 0.0f || simplify > 0.0 || !lodChain.empty() || normals != NormalsKeep || optimizeVertexCache
+		|| overdrawThreshold > 0.0f || optimizeVertexFetch || maxVertices || !meshletFile.empty();
+}
+
+
+Source::Source() {}
+
+Source::~Source() { close(); }
+
+bool Source::open(const std::string& path, std::string& error) {
+	close();
+	file = fopen(path.c_str(), "rb");
+	if (!file) {
+		error = "Failed to open file " + path;
+		return false;
+	}
+	filename = path;
+	fseeko(file, 0, SEEK_END);
+	filesize = ftello(file);
+	fseeko(file, 0, SEEK_SET);
+	buffer.resize(SOURCE_BLOCK + 1);
+	return true;
+}
+
+void Source::openMemory(const char* data, size_t size, const std::string& name) {
+	close();
+	memory = data;
+	filesize = size;
+	filename = name;
+	buffer.resize(SOURCE_BLOCK + 1);
+}
+
+void Source::close() {
+	if (file) fclose(file);
+	file = nullptr;
+	memory = nullptr;
+	filesize = 0;
+	begin = end = 0;
+	eof = false;
+}
+
+bool Source::rewind() {
+	begin = end = 0;
+	eof = false;
+	if (file) return fseeko(file, 0, SEEK_SET) == 0;
+	return true;
+}
+
+// Moves the unconsumed tail to the front and appends the next block.
+// Memory sources are served directly without copying.
+bool Source::fill() {
+	if (eof) return false;
+	if (memory) {
+		eof = true;
+		return false;
+	}
+	size_t remaining = end - begin;
+	if (remaining && begin) memmove(&buffer[0], &buffer[begin], remaining);
+	begin = 0;
+	end = remaining;
+	if (buffer.size() - 1 - end < SOURCE_BLOCK / 2)
+		buffer.resize(buffer.size() * 2); // Very long line
+	size_t got = fread(&buffer[end], 1, buffer.size() - 1 - end, file);
+	end += got;
+	buffer[end] = '\0';
+	if (got == 0) eof = true;
+	return got > 0;
+}
+
+bool Source::readLine(const char*& line, size_t& length) {
+	if (memory) {
+		// Lines point straight into the caller's buffer, which is why memory
+		// sources guarantee only a readable '\n' or '\0' after lines ending at the buffer end
+		if (begin >= filesize) return false;
+		const char* start = memory + begin;
+		const char* nl = (const char*)memchr(start, '\n', filesize - begin);
+		size_t len = nl ? nl - start : filesize - begin;
+		begin += len + 1;
+		if (!nl) {
+			// Last line without terminator: copy so it can be terminated
+			buffer.assign(start, start + len);
+			buffer.push_back('\0');
+			start = &buffer[0];
+		}
+		if (len && start[len - 1] == '\r') --len;
+		line = start;
+		length = len;
+		return true;
+	}
+	for (;;) {
+		const char* start = &buffer[begin];
+		const char* nl = (const char*)memchr(start, '\n', end - begin);
+		if (nl) {
+			size_t len = nl - start;
+			begin += len + 1;
+			if (len && start[len - 1] == '\r') --len;
+			line = start;
+			length = len;
+			return true;
+		}
+		if (!fill()) {
+			if (begin >= end) return false;
+			// Last line without terminator, buffer[end] is '\0'
+			size_t len = end - begin;
+			line = &buffer[begin];
+			begin = end;
+			if (len && line[len - 1] == '\r') --len;
+			length = len;
+			return true;
+		}
+	}
+}
+
+
+Sink::Sink(std::ostream& out): out(out) {}
+
+Sink::~Sink() { flush(); }
+
+void Sink::write(const char* data, size_t length) {
+	if (used + length > sizeof(buffer)) {
+		flush();
+		if (length > sizeof(buffer)) {
+			out.write(data, length);
+			flushed += length;
+			return;
+		}
+	}
+	memcpy(buffer + used, data, length);
+	used += length;
+}
+
+void Sink::number(float value) {
+	char tmp[32];
+	int len = snprintf(tmp, sizeof(tmp), "%g", value);
+	write(tmp, len);
+}
+
+void Sink::exactNumber(float value) {
+	char tmp[32];
+	int len = 0;
+	for (int precision = 6; precision <= 9; ++precision) {
+		len = snprintf(tmp, sizeof(tmp), "%.*g", precision, value);
+		float parsed;
+		if (parseFloat(tmp, parsed) && parsed == value) break;
+	}
+	write(tmp, len);
+}
+
+void Sink::flush() {
+	if (used) out.write(buffer, used);
+	flushed += used;
+	used = 0;
+}
+
+
+Info analyze(Source& source) {
+	Info info;
+	info.lbound = vec3(std::numeric_limits<float>::max());
+	info.ubound = vec3(-std::numeric_limits<float>::max());
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		if (len < 2) continue;
+		if (STARTS_WITH(row, len, "v ")) {  // Vertices
+			vec3 in;
+			parseFloats(row + 2, &in.x, 3);
+			info.lbound = min(in, info.lbound);
+			info.ubound = max(in, info.ubound);
+			++info.vertices;
+		}
+		else if (STARTS_WITH(row, len, "vt ")) ++info.texcoords;
+		else if (STARTS_WITH(row, len, "vn ")) ++info.normals;
+		else if (STARTS_WITH(row, len, "p ")) ++info.points;
+		else if (STARTS_WITH(row, len, "l ")) ++info.lines;
+		else if (STARTS_WITH(row, len, "f ")) ++info.faces;
+		else if (STARTS_WITH(row, len, "o ")) ++info.objects;
+		else if (STARTS_WITH(row, len, "usemtl ")) info.materials[std::string(row + 7, len - 7)]++;
+	}
+	source.rewind();
+	return info;
+}
+
+void writeInfo(std::ostream& out, const std::string& name, const Info& info) {
+	out << "Filename:      " << name << std::endl;
+	out << "Vertices:      " << info.vertices << std::endl;
+	out << "TexCoords:     " << info.texcoords << std::endl;
+	out << "Normals:       " << info.normals << std::endl;
+	out << "Faces:         " << info.faces << std::endl;
+	out << "Points:        " << info.points << std::endl;
+	out << "Lines:         " << info.lines << std::endl;
+	out << "Named objects: " << info.objects << std::endl;
+	out << "Materials:     " << info.materials.size() << std::endl;
+	out << "              " << std::right << std::setw(W) << "x" << std::setw(W) << "y" << std::setw(W) << "z" << std::endl;
+	out << "Center:       " << toString(info.center()) << std::endl;
+	out << "Size:         " << toString(info.size()) << std::endl;
+	out << "Lower bounds: " << toString(info.lbound) << std::endl;
+	out << "Upper bounds: " << toString(info.ubound) << std::endl;
+}
+
+void writeReport(std::ostream& out, const Report& report) {
+	for (const auto& entry : report.entries) {
+		std::string label = entry.first + ":";
+		out << label << std::string(label.size() < 15 ? 15 - label.size() : 1, ' ') << entry.second << std::endl;
+	}
+}
+
+bool writeToTemp(const std::function<bool(Sink&)>& write, Source& result, std::string& error) {
+	const char* tmpdir = getenv("TMPDIR");
+	std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/obj-magic.XXXXXX";
+	int fd = mkstemp(&path[0]);
+	if (fd < 0) {
+		error = "Failed to create temp file " + path;
+		return false;
+	}
+	::close(fd);
+	bool ok;
+	{
+		std::ofstream file(path.c_str(), std::ios::binary);
+		Sink sink(file);
+		ok = write(sink);
+	}
+	ok = ok && result.open(path, error);
+	unlink(path.c_str());
+	return ok;
+}
+
+bool processToTemp(Source& source, Source& result, const Options& options, std::string& error,
+	const Info* info, Report* report)
+{
+	return writeToTemp([&](Sink& sink) { return process(source, sink, options, error, info, report); },
+		result, error);
+}
+
+bool process(Source& source, Sink& out, const Options& options, std::string& error, const Info* info, Report* report) {
+	if (options.optimizeMaterials)
+		return processRegroup(source, out, options, error, info, report);
+	if (options.deletes() && (options.needsMesh() || options.needsAnalysis()))
+		return processDeleteFirst(source, out, options, error, report);
+	if (options.clusterDecimate > 0.0f)
+		return processDecimate(source, out, options, error, info, report);
+	if (options.removesFaces())
+		return processRemoveFaces(source, out, options, error, info, report);
+	if (options.needsMesh())
+		return processMesh(source, out, options, error, info, report);
+
+	Info analyzed;
+	if (options.needsAnalysis() && !info) {
+		analyzed = analyze(source);
+		info = &analyzed;
+	}
+	Transform transform(options, options.needsAnalysis() ? info : nullptr);
+
+	// Reference pass for --clean and deleting, which drops what only deleted elements use
+	ElementFilter filter(options);
+	bool remapping = options.clean || filter.active();
+	References refs, deletedRefs;
+	if (remapping && !markReferences(source, refs, error, &filter, &deletedRefs))
+		return false;
+	if (filter.active() && !options.clean) {
+		refs.v.setUnset(deletedRefs.v);
+		refs.vt.setUnset(deletedRefs.vt);
+		refs.vn.setUnset(deletedRefs.vn);
+	}
+	Remap remapV(refs.v), remapVT(refs.vt), remapVN(refs.vn);
+	const Remap* const remaps[3] = { &remapV, &remapVT, &remapVN };
+	ElementCounts sofar, kept; // Elements before the current row, originally and after removal
+	std::string rewritten;
+	FaceTriangulator triangulator;
+	uint64_t deleted[3] = {}; // f, l and p records
+
+	auto outputUnmodifiedRow = [&out](const char* row, size_t len) {
+		out.write(row, len);
+		out.put('\n');
+	};
+
+	// Output pass
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		vec3 in;
+		if (STARTS_WITH(row, len, "v ")) {  // Vertices
+			parseFloats(row + 2, &in.x, 3);
+			if (options.triangulate) triangulator.addVertex(in);
+			if (remapping && !remapV.kept(sofar.v)) { ++sofar.v; continue; }
+			++sofar.v;
+			++kept.v;
+			vec3 old = in;
+			in = transform.vertex(in);
+			if (old != in) {
+				out.write("v ", 2);
+				out.number(in.x); out.put(' '); out.number(in.y); out.put(' '); out.number(in.z);
+				out.put('\n');
+			} else outputUnmodifiedRow(row, len);
+		} else if (STARTS_WITH(row, len, "vt ")) {  // Tex coords
+			if (remapping && !remapVT.kept(sofar.vt)) { ++sofar.vt; continue; }
+			++sofar.vt;
+			++kept.vt;
+			parseFloats(row + 3, &in.x, 2);
+			vec3 old = in;
+			in = transform.texCoord(in);
+			if (old != in) {
+				out.write("vt ", 3);
+				out.number(in.x); out.put(' '); out.number(in.y);
+				out.put('\n');
+			} else outputUnmodifiedRow(row, len);
+		} else if (STARTS_WITH(row, len, "vn ")) {  // Normals
+			if (remapping && !remapVN.kept(sofar.vn)) { ++sofar.vn; continue; }
+			++sofar.vn;
+			++kept.vn;
+			parseFloats(row + 3, &in.x, 3);
+			vec3 old = in;
+			in = transform.normal(in);
+			if (old != in) {
+				out.write("vn ", 3);
+				out.number(in.x); out.put(' '); out.number(in.y); out.put(' '); out.number(in.z);
+				out.put('\n');
+			} else outputUnmodifiedRow(row, len);
+		} else if ((remapping || options.triangulate) && len >= 2 && row[1] == ' '
+			&& (row[0] == 'f' || row[0] == 'l' || row[0] == 'p')) {
+			if (filter.deleting()) {
+				++deleted[row[0] == 'f' ? 0 : row[0] == 'l' ? 1 : 2];
+				continue;
+			}
+			const char* output = row;
+			size_t outputLen = len;
+			if (remapping) {
+				if (!remapIndices(row, len, sofar, kept, remaps, rewritten)) {
+					error = "Invalid index in " + source.name() + ": " + std::string(row, len);
+					return false;
+				}
+				output = rewritten.data();
+				outputLen = rewritten.size();
+			}
+			if (!options.triangulate || row[0] != 'f') {
+				outputUnmodifiedRow(output, outputLen);
+			} else if (!triangulator.write(row, len, output, outputLen, sofar, out)) {
+				error = "Malformed face in " + source.name() + ": " + std::string(row, len);
+				return false;
+			}
+		} else if (!filter.active() || filter.update(row, len)) {
+			outputUnmodifiedRow(row, len);
+		}
+	}
+	if (filter.active() && report) {
+		report->add("Deleted f", deleted[0]);
+		report->add("Deleted l", deleted[1]);
+		report->add("Deleted p", deleted[2]);
+	}
+	if (remapping && report)
+		reportRemoved(*report, remapV, remapVT, remapVN);
+	if (options.triangulate && report)
+		triangulator.report(*report);
+	out.flush();
+	if (!out.good()) {
+		error = "Failed to write output for " + source.name();
+		return false;
+	}
+	return true;
+}
+
+} // namespace objmagic
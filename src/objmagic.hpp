@@ -0,0 +1,223 @@
+#pragma once
+
+// libobjmagic - streaming Wavefront OBJ analysis and transformation.
+//
+// Typical use:
+//   objmagic::Options options;
+//   options.parse(argumentList, error);
+//   objmagic::Source source;
+//   source.open("model.obj", error);
+//   objmagic::Sink sink(std::cout);
+//   objmagic::process(source, sink, options, error);
+//
+// Nothing in here uses global state: Options and Info are plain values that can be
+// shared between threads, Source and Sink objects are meant for one thread at a time.
+// Parallel operations run on the thread pool of the options, which callers running many
+// invocations at once share between them so that they don't start threads of their own.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <ostream>
+#include <cstdio>
+#include <cstdint>
+
+#include "../glm/vec2.hpp"
+#include "../glm/vec3.hpp"
+#include "../glm/mat3x3.hpp"
+
+#define OBJMAGIC_APPNAME "obj-magic"
+#define OBJMAGIC_VERSION "v0.5"
+
+class ThreadPool;
+
+namespace objmagic {
+
+// How normals are generated
+enum NormalMode {
+	NormalsKeep,   // Existing normals are kept
+	NormalsFlat,   // One per face
+	NormalsSmooth, // Averaged around vertices
+	NormalsAuto    // Averaged, except across edges sharper than the crease angle
+};
+
+// What --split-by starts a new output file at
+enum SplitMode {
+	SplitNone,
+	SplitObject,   // o records
+	SplitGroup,    // g records
+	SplitMaterial  // usemtl records
+};
+
+// Operations to apply, typically parsed from the same parameters the command line takes
+struct Options {
+	bool info = false;
+	bool normalizeNormals = false;
+	glm::vec3 normalScale = glm::vec3(1.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+	glm::vec2 scaleUv = glm::vec2(1.0f);
+	bool flipUvX = false;
+	bool flipUvY = false;
+	glm::vec3 translate;
+	glm::vec3 center;       // 1 for axes to center, 0 for others
+	glm::ivec3 mirror = glm::ivec3(1);
+	glm::vec3 fit;          // Target size per axis, 0 = no fitting
+	bool fitUniform = false; // Fit the largest dimension (--fit without axis suffix)
+	glm::vec3 resize;       // Target size per axis, 0 = no resizing
+	glm::mat3 rotation = glm::mat3(1.0f);
+	bool clean = false;     // Remove unreferenced v, vt and vn
+	bool dedupe = false;    // Merge v, vt and vn with identical values
+	float weld = 0.0f;      // Merge vertices closer than this on every axis
+	bool keepSeams = false; // Don't weld vertices with different tex coords or normals
+	bool triangulate = false; // Split polygons into triangles
+	double simplify = 0.0;    // Triangles to keep, as a fraction if at most 1, 0 = all
+	bool removeDegenerate = false;     // Remove faces with repeated vertices or no area
+	float degenerateArea = 0.0f;       // Faces with less area count as having none
+	bool removeDuplicateFaces = false; // Remove faces with the same vertices as an earlier one
+	float clusterDecimate = 0.0f; // Size of the grid cells vertices are merged in, 0 = no clustering
+	std::vector<double> lodChain; // Fractions of the triangles in each added level of detail
+	bool lodFiles = false;    // Write each level of detail to its own file
+	std::string lodName;      // Levels of detail are objects NAME_LOD0, NAME_LOD1, ... (LOD0, ... if empty)
+	bool optimizeVertexCache = false; // Reorder faces for GPU vertex cache hits
+	float overdrawThreshold = 0.0f;   // Reorder face clusters against overdraw, allowing this much worse ACMR
+	bool optimizeVertexFetch = false; // Renumber v, vt and vn in order of first use
+	NormalMode normals = NormalsKeep;
+	float creaseAngle = 30.0f; // Degrees, for NormalsAuto
+	std::vector<std::string> deleteMaterials; // Names whose faces, lines and points are deleted
+	std::vector<std::string> deleteGroups;
+	std::vector<std::string> deleteObjects;
+	size_t maxVertices = 0;   // Distinct vertices per chunk of faces, 0 = no limit
+	std::string meshletFile;  // Where to write meshlets of the faces, empty = none
+	SplitMode splitBy = SplitNone;
+	bool merge = false;       // Concatenate the input files into one output
+	bool prefixNames = false; // Prefix merged object and group names with their file name
+	bool optimizeMaterials = false;   // Make the faces of each material a single run
+	size_t bufferSize = 64 << 20;     // Bytes of faces to regroup in memory before using temp files
+	bool indexed = false;   // Go through the in-memory indexed mesh even if streaming would do
+	ThreadPool* pool = nullptr; // Workers for parallel operations, each call makes its own if null
+
+	// Parse command line style parameters, e.g. {"--scale", "2", "--centerx"}.
+	// Arguments not starting with a dash are ignored (they are file names for the CLI).
+	bool parse(const std::vector<std::string>& params, std::string& error);
+	// Whether bounds of the mesh are needed before output can be produced
+	bool needsAnalysis() const;
+	// Whether the whole mesh has to be loaded into memory
+	bool needsMesh() const;
+	// Whether elements are deleted by name
+	bool deletes() const { return !deleteMaterials.empty() || !deleteGroups.empty() || !deleteObjects.empty(); }
+	// Whether degenerate or duplicate faces are removed
+	bool removesFaces() const { return removeDegenerate || removeDuplicateFaces; }
+	// Whether any operation besides regrouping by material changes the mesh
+	bool changesMesh() const;
+};
+
+// Results of the analyzing pass
+struct Info {
+	unsigned long long vertices = 0, texcoords = 0, normals = 0;
+	unsigned long long faces = 0, points = 0, lines = 0, objects = 0;
+	std::map<std::string, unsigned> materials;
+	glm::vec3 lbound;
+	glm::vec3 ubound;
+
+	glm::vec3 center() const { return (lbound + ubound) * 0.5f; }
+	glm::vec3 size() const { return ubound - lbound; }
+};
+
+// Statistics from operations, as label and value pairs
+struct Report {
+	std::vector<std::pair<std::string, std::string>> entries;
+
+	void add(const std::string& label, const std::string& value) { entries.emplace_back(label, value); }
+	template<typename T> void add(const std::string& label, T value) { add(label, std::to_string(value)); }
+};
+
+// Line oriented reader for a seekable file or a memory buffer.
+// Returned lines exclude the line terminator (both \n and \r\n) and stay valid
+// until the next call. The byte after a line is always readable and is either
+// part of its terminator or '\0', so number parsing can safely stop there.
+class Source {
+public:
+	Source();
+	~Source();
+	Source(const Source&) = delete;
+	Source& operator=(const Source&) = delete;
+
+	bool open(const std::string& path, std::string& error);
+	// Read from memory owned by the caller; data must outlive the Source
+	void openMemory(const char* data, size_t size, const std::string& name = "");
+	void close();
+
+	bool readLine(const char*& line, size_t& length);
+	// Start over from the beginning for another pass
+	bool rewind();
+
+	const std::string& name() const { return filename; }
+	uint64_t size() const { return filesize; }
+
+private:
+	bool fill();
+
+	std::string filename;
+	FILE* file = nullptr;
+	const char* memory = nullptr;
+	uint64_t filesize = 0;
+	std::vector<char> buffer;
+	size_t begin = 0, end = 0;
+	bool eof = false;
+};
+
+// Buffered output to any std::ostream
+class Sink {
+public:
+	explicit Sink(std::ostream& out);
+	~Sink();
+	Sink(const Sink&) = delete;
+	Sink& operator=(const Sink&) = delete;
+
+	void write(const char* data, size_t length);
+	void write(const std::string& str) { write(str.data(), str.size()); }
+	void put(char c) {
+		if (used == sizeof(buffer)) flush();
+		buffer[used++] = c;
+	}
+	// Same formatting as std::ostream << float
+	void number(float value);
+	// Shortest "%g" style representation that reads back as the same float
+	void exactNumber(float value);
+	void flush();
+	bool good() const { return out.good(); }
+	// Bytes written so far, buffered ones included
+	uint64_t written() const { return flushed + used; }
+
+private:
+	std::ostream& out;
+	uint64_t flushed = 0;
+	size_t used = 0;
+	char buffer[1 << 16];
+};
+
+// Analyzing pass: counts elements and computes bounds. Rewinds the source when done.
+Info analyze(Source& source);
+
+// Human readable report of the analyzing pass, as printed by --info
+void writeInfo(std::ostream& out, const std::string& name, const Info& info);
+
+// Report lines formatted like --info
+void writeReport(std::ostream& out, const Report& report);
+
+// Apply options to the source and write the result to the sink.
+// If the options need analysis and no precomputed info is given, an analyzing pass is run first.
+// Operations that produce statistics add them to the report if one is given.
+bool process(Source& source, Sink& sink, const Options& options, std::string& error,
+	const Info* info = nullptr, Report* report = nullptr);
+
+// Runs write on a temp file that is then opened as result, for operations that take the
+// output of others as their input. The file is gone once result is closed.
+bool writeToTemp(const std::function<bool(Sink&)>& write, Source& result, std::string& error);
+
+// Like process, but into a temp file opened as result
+bool processToTemp(Source& source, Source& result, const Options& options, std::string& error,
+	const Info* info = nullptr, Report* report = nullptr);
+
+} // namespace objmagic
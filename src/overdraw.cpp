@@ -0,0 +1,259 @@
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+
+#include "../glm/geometric.hpp"
+#include "overdraw.hpp"
+#include "vertexcache.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+const int ViewportSize = 256;
+const int FifoSize = 16;
+
+std::string format(double value) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%.3f", value);
+	return tmp;
+}
+
+// Depth tested rasterizer counting shaded fragments
+struct Rasterizer {
+	std::vector<float> depth;
+	uint64_t shaded = 0;
+
+	Rasterizer(): depth(ViewportSize * ViewportSize, std::numeric_limits<float>::max()) {}
+
+	// Vertices in pixel coordinates, z as depth
+	void draw(vec3 a, vec3 b, vec3 c) {
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (area <= 0.0f) return; // Back facing or degenerate
+		int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+		int maxX = std::min(ViewportSize - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+		int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+		int maxY = std::min(ViewportSize - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+		for (int y = minY; y <= maxY; ++y) {
+			for (int x = minX; x <= maxX; ++x) {
+				float px = x + 0.5f, py = y + 0.5f;
+				float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+				float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+				float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+				float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+				float& stored = depth[y * ViewportSize + x];
+				if (z < stored) {
+					stored = z;
+					++shaded;
+				}
+			}
+		}
+	}
+
+	uint64_t covered() const {
+		uint64_t count = 0;
+		for (float z : depth)
+			if (z != std::numeric_limits<float>::max()) ++count;
+		return count;
+	}
+};
+
+// Vertex cache misses per triangle of faces [begin, end) of the order, with a cold FIFO cache
+struct CacheSimulator {
+	const Mesh& mesh;
+	const RenderVertices& vertices;
+	std::vector<uint64_t> stamp;
+	uint64_t time = 0;
+
+	CacheSimulator(const Mesh& mesh, const RenderVertices& vertices):
+		mesh(mesh), vertices(vertices), stamp(vertices.count, 0) {}
+
+	void reset() { time += FifoSize; }
+
+	// Misses of drawing the face as a fan
+	unsigned draw(Index face) {
+		unsigned misses = 0;
+		Index first = mesh.faces.offsets[face];
+		for (Index i = 1; i + 1 < mesh.faces.corners(face); ++i) {
+			const Index corners[] = { first, first + i, first + i + 1 };
+			for (Index c : corners) {
+				Index r = vertices.corners[c];
+				if (stamp[r] && time - stamp[r] < FifoSize) continue;
+				stamp[r] = ++time;
+				++misses;
+			}
+		}
+		return misses;
+	}
+};
+
+unsigned triangleCount(const Elements& faces, Index face) {
+	return faces.corners(face) >= 3 ? faces.corners(face) - 2 : 0;
+}
+
+// ACMR of drawing the faces in the order, the same as cacheStats gives once they are in it
+double orderAcmr(const Mesh& mesh, const RenderVertices& vertices, const Array<Index>& order) {
+	CacheSimulator cache(mesh, vertices);
+	uint64_t misses = 0, triangles = 0;
+	for (Index f : order) {
+		misses += cache.draw(f);
+		triangles += triangleCount(mesh.faces, f);
+	}
+	return triangles ? double(misses) / triangles : 0.0;
+}
+
+} // namespace
+
+double overdraw(const Mesh& mesh, const Array<Index>* order) {
+	const Elements& faces = mesh.faces;
+	Info info = mesh.analyze();
+	vec3 size = info.size();
+	float extent = std::max(size.x, std::max(size.y, size.z));
+	if (extent <= 0.0f) return 0.0;
+	float scale = (ViewportSize - 1) / extent;
+
+	uint64_t shaded = 0, covered = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int direction = -1; direction <= 1; direction += 2) {
+			// Looking along the axis in the given direction, depth grows away from the viewer
+			int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			auto project = [&](Index vertex) {
+				vec3 p = vec3(mesh.px[vertex], mesh.py[vertex], mesh.pz[vertex]) - info.lbound;
+				float x = p[u] * scale;
+				float y = p[v] * scale;
+				if (direction > 0) x = (ViewportSize - 1) - x; // Front faces wind counterclockwise
+				return vec3(x, y, p[axis] * direction);
+			};
+			Rasterizer rasterizer;
+			for (size_t i = 0; i < faces.size(); ++i) {
+				Index f = order ? (*order)[i] : i;
+				Index first = faces.offsets[f];
+				for (Index i = 1; i + 1 < faces.corners(f); ++i)
+					rasterizer.draw(project(faces.v[first]), project(faces.v[first + i]), project(faces.v[first + i + 1]));
+			}
+			shaded += rasterizer.shaded;
+			covered += rasterizer.covered();
+		}
+	}
+	return covered ? double(shaded) / covered : 0.0;
+}
+
+void optimizeOverdraw(Mesh& mesh, float threshold, Report* report) {
+	const Elements& faces = mesh.faces;
+	RenderVertices vertices(mesh);
+	double overdrawBefore = overdraw(mesh);
+	CacheStats cacheBefore = cacheStats(mesh, vertices);
+
+	// Area weighted centroid and normal of each face
+	std::vector<vec3> centroids(faces.size()), normals(faces.size());
+	vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t f = 0; f < faces.size(); ++f) {
+		Index first = faces.offsets[f];
+		auto position = [&](Index c) { Index v = faces.v[c]; return vec3(mesh.px[v], mesh.py[v], mesh.pz[v]); };
+		vec3 normal(0.0f), centroid(0.0f);
+		for (Index i = 1; i + 1 < faces.corners(f); ++i) {
+			vec3 a = position(first), b = position(first + i), c = position(first + i + 1);
+			vec3 n = cross(b - a, c - a);
+			normal += n;
+			centroid += (a + b + c) * (length(n) / 3.0f);
+		}
+		float area = length(normal);
+		normals[f] = normal;
+		centroids[f] = centroid;
+		meshCentroid += centroid;
+		meshArea += area;
+		if (area > 0.0f) centroids[f] /= area;
+	}
+	if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+	struct Cluster {
+		Index first, count;
+		float sortKey;
+	};
+	Array<Index> order;
+	order.reserve(faces.size());
+	CacheSimulator cache(mesh, vertices);
+	std::vector<Cluster> clusters;
+	for (const Range& run : mesh.faceRuns()) {
+		clusters.clear();
+		Index end = run.first + run.count;
+		// Hard boundaries where the cache gets no hits, they can be moved for free
+		std::vector<Index> hard;
+		cache.reset();
+		for (Index f = run.first; f < end; ++f) {
+			unsigned misses = cache.draw(f);
+			if (f == run.first || (triangleCount(faces, f) && misses >= faces.corners(f)))
+				hard.push_back(f);
+		}
+		hard.push_back(end);
+
+		// Soft boundaries within them, wherever the ACMR so far is good enough
+		for (size_t h = 0; h + 1 < hard.size(); ++h) {
+			Index begin = hard[h], stop = hard[h + 1];
+			cache.reset();
+			uint64_t misses = 0, triangles = 0;
+			for (Index f = begin; f < stop; ++f) {
+				misses += cache.draw(f);
+				triangles += triangleCount(faces, f);
+			}
+			double limit = triangles ? threshold * double(misses) / triangles : 0.0;
+			Index start = begin;
+			cache.reset();
+			misses = triangles = 0;
+			for (Index f = begin; f < stop; ++f) {
+				misses += cache.draw(f);
+				triangles += triangleCount(faces, f);
+				if (f + 1 < stop && triangles && double(misses) / triangles <= limit) {
+					clusters.push_back(Cluster{ start, f + 1 - start, 0.0f });
+					start = f + 1;
+					cache.reset();
+					misses = triangles = 0;
+				}
+			}
+			clusters.push_back(Cluster{ start, stop - start, 0.0f });
+		}
+
+		// Clusters facing away from the center first
+		for (Cluster& cluster : clusters) {
+			vec3 centroid(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (Index f = cluster.first; f < cluster.first + cluster.count; ++f) {
+				float a = length(normals[f]);
+				centroid += centroids[f] * a;
+				normal += normals[f];
+				area += a;
+			}
+			if (area > 0.0f) centroid /= area;
+			float len = length(normal);
+			cluster.sortKey = len > 0.0f ? dot(centroid - meshCentroid, normal / len) : 0.0f;
+		}
+		std::stable_sort(clusters.begin(), clusters.end(),
+			[](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+		for (const Cluster& cluster : clusters)
+			for (Index f = cluster.first; f < cluster.first + cluster.count; ++f)
+				order.push_back(f);
+	}
+
+	// The faces stay as they are unless the new order draws less overdraw within the ACMR bound
+	double acmrAfter = orderAcmr(mesh, vertices, order);
+	double overdrawAfter = overdraw(mesh, &order);
+	bool acmrKept = acmrAfter <= threshold * cacheBefore.acmr;
+	bool reordered = acmrKept && overdrawAfter < overdrawBefore;
+	if (reordered) mesh.permuteFaces(order);
+
+	if (report) {
+		report->add("Overdraw before", format(overdrawBefore));
+		report->add("Overdraw after", format(reordered ? overdrawAfter : overdrawBefore));
+		report->add("Overdraw ACMR", format(cacheBefore.acmr) + " -> " + format(reordered ? acmrAfter : cacheBefore.acmr));
+		report->add("Overdraw order", reordered ? "clusters reordered"
+			: !acmrKept ? "kept, ACMR would grow " + format(acmrAfter / cacheBefore.acmr) + " times"
+			: "kept, no less overdraw");
+	}
+}
+
+} // namespace objmagic
@@ -0,0 +1,24 @@
+#pragma once
+
+// Face ordering against overdraw
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Average number of times each covered pixel is shaded when drawing the faces in order (or
+// in the given order of face indices), over orthographic views along the six axis directions
+// with back faces culled
+double overdraw(const Mesh& mesh, const Array<Index>* order = nullptr);
+
+// Splits every run of faces (see Mesh::faceRuns) into clusters at points where the vertex
+// cache ACMR of the cluster stays within threshold times that of the run section it is cut
+// from, and orders the clusters so that those facing away from the center of the mesh,
+// which tend to occlude the rest, are drawn first. The new order is only used if it has less
+// overdraw and its ACMR is at most threshold times that of the faces as they were, otherwise
+// the faces are left as they are. Best used after optimizeVertexCache. Reports overdraw and
+// ACMR before and after and whether the faces were reordered.
+void optimizeOverdraw(Mesh& mesh, float threshold, Report* report);
+
+} // namespace objmagic
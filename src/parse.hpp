@@ -0,0 +1,160 @@
+#pragma once
+
+// Allocation-free parsers for the numeric parts of OBJ records.
+// Everything is inline as these sit in the innermost loops of every pass.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace objmagic {
+
+namespace detail {
+
+static const double exactPowersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isDigit(char c) { return (unsigned)(c - '0') < 10; }
+inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+} // namespace detail
+
+// Parses one float, returning the end of it or nullptr if there is none.
+// Gives the same results as strtof in the "C" locale. Literals with at most 15 significant
+// digits and a small exponent take the fast path: the decimal is first rounded to double
+// with a single exact-operand operation and then to float. That double rounding is only
+// wrong when the double lands exactly halfway between two floats, so those and anything
+// unusual are left to strtof.
+inline const char* parseFloat(const char* p, float& out) {
+	using namespace detail;
+	const char* start = p;
+	while (isBlank(*p)) ++p;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+') ++p;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for (; isDigit(*p); ++p, any = true) {
+		if (mantissa || *p != '0') ++digits;
+		mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (*p == '.') {
+		for (++p; isDigit(*p); ++p, any = true) {
+			if (mantissa || *p != '0') ++digits;
+			mantissa = mantissa * 10 + (*p - '0');
+			--exponent;
+		}
+	}
+	if (!any) {
+		// Leave inf and nan to strtof, but never let it skip past the end of the line
+		char c = *p | 0x20;
+		if (c != 'i' && c != 'n') return nullptr;
+		goto slow;
+	}
+	if (digits > 15) goto slow;
+	if (*p == 'e' || *p == 'E') {
+		const char* e = p + 1;
+		bool negativeExp = *e == '-';
+		if (*e == '-' || *e == '+') ++e;
+		if (!isDigit(*e)) goto slow;
+		int exp = 0;
+		for (; isDigit(*e); ++e) {
+			exp = exp * 10 + (*e - '0');
+			if (exp > 100) goto slow;
+		}
+		exponent += negativeExp ? -exp : exp;
+		p = e;
+	}
+	if (mantissa == 0) {
+		out = negative ? -0.0f : 0.0f;
+		return p;
+	}
+	if (exponent < -22 || exponent > 22) goto slow;
+	{
+		double value = (double)mantissa;
+		value = exponent < 0 ? value / exactPowersOf10[-exponent] : value * exactPowersOf10[exponent];
+		// Outside the normal float range, or exactly halfway between two floats
+		if (value < 1.17549435e-38 || value > 3.40282346e+38) goto slow;
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		if ((bits & 0x1FFFFFFF) == 0x10000000) goto slow;
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+slow:
+	char* end;
+	out = strtof(start, &end);
+	return end == start ? nullptr : end;
+}
+
+// Parses up to count floats like istream >> float would, stopping at the first failure.
+// Values not parsed are left untouched. Returns the number of values parsed.
+inline int parseFloats(const char* p, float* out, int count) {
+	for (int i = 0; i < count; ++i) {
+		p = parseFloat(p, out[i]);
+		if (!p) return i;
+	}
+	return count;
+}
+
+// Number of elements defined so far, needed to resolve negative (relative) indices
+struct ElementCounts {
+	uint64_t v = 0, vt = 0, vn = 0;
+};
+
+// Marks a missing texture coordinate or normal in a tuple
+template<typename Index> inline Index noIndex() { return ~Index(0); }
+
+// Parses the index tuples of an f, l or p record (the part after the keyword) into a
+// flat buffer of (v, vt, vn) triples: v, v/vt, v//vn and v/vt/vn are accepted and
+// negative indices are resolved against counts. Indices are converted to 0-based,
+// missing ones are stored as noIndex<Index>(). At most capacity tuples are written.
+// Returns the number of tuples in the record, which may exceed capacity so the
+// caller can retry with a larger buffer, or -1 if the record is malformed.
+template<typename Index>
+inline int parseIndexTuples(const char* p, const char* end, const ElementCounts& counts, Index* out, int capacity) {
+	using namespace detail;
+	// Reads one optionally signed index and resolves it, false if malformed
+	auto index = [&p, end](uint64_t count, Index& result) {
+		bool negative = *p == '-';
+		if (negative) ++p;
+		if (p >= end || !isDigit(*p)) return false;
+		uint64_t value = 0;
+		for (; p < end && isDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+		if (value == 0 || value > (uint64_t)noIndex<Index>() - 1) return false;
+		if (negative) {
+			if (value > count) return false;
+			result = (Index)(count - value);
+		} else result = (Index)(value - 1);
+		return true;
+	};
+
+	int tuples = 0;
+	for (;;) {
+		while (p < end && isBlank(*p)) ++p;
+		if (p >= end || *p == '#') break;
+		Index v, vt = noIndex<Index>(), vn = noIndex<Index>();
+		if (!index(counts.v, v)) return -1;
+		if (p < end && *p == '/') {
+			++p;
+			if (p < end && *p != '/' && !index(counts.vt, vt)) return -1;
+			if (p < end && *p == '/') {
+				++p;
+				if (!index(counts.vn, vn)) return -1;
+			}
+		}
+		if (p < end && !isBlank(*p) && *p != '#') return -1;
+		if (tuples < capacity) {
+			out[tuples * 3] = v;
+			out[tuples * 3 + 1] = vt;
+			out[tuples * 3 + 2] = vn;
+		}
+		++tuples;
+	}
+	return tuples;
+}
+
+} // namespace objmagic
@@ -0,0 +1,42 @@
+#pragma once
+
+// Quadric error metric (Garland and Heckbert) shared by the simplifiers
+
+#include <algorithm>
+
+#include "../glm/vec3.hpp"
+#include "../glm/geometric.hpp"
+
+namespace objmagic {
+
+// Weighted sum of squared distances to planes
+struct Quadric {
+	double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, weight = 0;
+
+	Quadric() {}
+	// Plane with unit normal n through point
+	Quadric(const glm::vec3& n, const glm::vec3& point, double w) {
+		double x = n.x, y = n.y, z = n.z, d = -glm::dot(n, point);
+		a2 = x * x * w; ab = x * y * w; ac = x * z * w; ad = x * d * w;
+		b2 = y * y * w; bc = y * z * w; bd = y * d * w;
+		c2 = z * z * w; cd = z * d * w; d2 = d * d * w;
+		weight = w;
+	}
+
+	Quadric& operator+=(const Quadric& o) {
+		a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd;
+		c2 += o.c2; cd += o.cd; d2 += o.d2; weight += o.weight;
+		return *this;
+	}
+
+	// Weighted mean of the squared distances of p to the planes
+	double error(const glm::vec3& p) const {
+		if (weight <= 0.0) return 0.0;
+		double x = p.x, y = p.y, z = p.z;
+		double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+			+ 2.0 * (ad * x + bd * y + cd * z) + d2;
+		return std::max(e, 0.0) / weight;
+	}
+};
+
+} // namespace objmagic
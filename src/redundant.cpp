@@ -0,0 +1,177 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+#include "../glm/geometric.hpp"
+#include "redundant.hpp"
+#include "mesh.hpp"
+#include "parse.hpp"
+
+#define DEGENERATE_RATIO 1e-6f // Faces this thin relative to their longest edge have no area
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+static const uint64_t Empty = ~0ull;
+
+inline bool startsWith(const char* row, size_t len, const char* prefix, size_t prefixLen) {
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+#define STARTS_WITH(row, len, prefix) startsWith(row, len, prefix, sizeof(prefix) - 1)
+
+uint64_t hashFace(const Index* v, size_t n) {
+	uint64_t hash = n;
+	for (size_t i = 0; i < n; ++i)
+		hash = (hash ^ v[i]) * 0x9E3779B97F4A7C15ull;
+	return hash ^ hash >> 29;
+}
+
+// Faces seen so far, by their vertex indices rotated to start from the lowest one
+class FaceSet {
+public:
+	FaceSet(): slots(1024, Empty), tags(1024) {}
+
+	// Adds the face, false if it was there already
+	bool insert(const Index* v, size_t n) {
+		uint64_t hash = hashFace(v, n);
+		if ((count + 1) * 2 > slots.size()) grow();
+		size_t mask = slots.size() - 1;
+		uint32_t tag = hash >> 32;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			if (slots[i] == Empty) {
+				slots[i] = store.size();
+				tags[i] = tag;
+				store.push_back(n);
+				store.insert(store.end(), v, v + n);
+				++count;
+				return true;
+			}
+			const Index* other = &store[slots[i]];
+			if (tags[i] == tag && other[0] == n && std::equal(v, v + n, other + 1)) return false;
+		}
+	}
+
+private:
+	void grow() {
+		std::vector<uint64_t> oldSlots(slots.size() * 2, Empty);
+		std::vector<uint32_t> oldTags(tags.size() * 2);
+		std::swap(slots, oldSlots);
+		std::swap(tags, oldTags);
+		size_t mask = slots.size() - 1;
+		// The tag is the upper half of the hash, the rest is lost, so hash again
+		for (size_t j = 0; j < oldSlots.size(); ++j) {
+			if (oldSlots[j] == Empty) continue;
+			const Index* face = &store[oldSlots[j]];
+			size_t i = hashFace(face + 1, face[0]) & mask;
+			while (slots[i] != Empty) i = (i + 1) & mask;
+			slots[i] = oldSlots[j];
+			tags[i] = oldTags[j];
+		}
+	}
+
+	std::vector<uint64_t> slots; // Where the faces start in store
+	std::vector<uint32_t> tags;  // Upper half of the hash of each face, to skip most comparisons
+	std::vector<Index> store;    // Corner count and vertex indices of each face
+	size_t count = 0;
+};
+
+} // namespace
+
+bool removeRedundantFaces(Source& source, Sink* out, const Options& options, std::string& error, Report* report) {
+	bool checkArea = options.removeDegenerate;
+	std::vector<vec3> positions;
+	FaceSet seen;
+	ElementCounts sofar;
+	std::vector<uint64_t> tuples(3 * 16);
+	std::vector<Index> rotated, sorted;
+	uint64_t degenerate = 0, duplicates = 0;
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		if (STARTS_WITH(row, len, "v ")) {
+			if (checkArea) {
+				vec3 p;
+				parseFloats(row + 2, &p.x, 3);
+				positions.push_back(p);
+			}
+			++sofar.v;
+		} else if (STARTS_WITH(row, len, "vt ")) {
+			++sofar.vt;
+		} else if (STARTS_WITH(row, len, "vn ")) {
+			++sofar.vn;
+		} else if (STARTS_WITH(row, len, "f ")) {
+			int n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+			if (n > (int)tuples.size() / 3) {
+				tuples.resize(3 * n);
+				n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], n);
+			}
+			if (n < 0) {
+				error = "Malformed face in " + source.name() + ": " + std::string(row, len);
+				return false;
+			}
+			rotated.resize(n);
+			size_t lowest = 0;
+			for (int i = 0; i < n; ++i) {
+				if (tuples[i * 3] >= NoIndex) {
+					error = source.name() + " is too large for 32-bit indices, build with OBJMAGIC_64BIT_INDICES";
+					return false;
+				}
+				if (tuples[i * 3] < tuples[lowest * 3]) lowest = i;
+			}
+			for (int i = 0; i < n; ++i)
+				rotated[i] = tuples[((lowest + i) % n) * 3];
+
+			bool drop = false;
+			if (options.removeDegenerate) {
+				sorted.assign(rotated.begin(), rotated.end());
+				std::sort(sorted.begin(), sorted.end());
+				drop = n < 3 || std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end();
+				bool known = true;
+				for (int i = 0; i < n && known; ++i) known = rotated[i] < positions.size();
+				if (!drop && known) {
+					// Newell's normal, twice the area for a planar polygon
+					const vec3& base = positions[rotated[0]];
+					vec3 normal(0.0f);
+					float longest = 0.0f;
+					for (int i = 0; i < n; ++i) {
+						const vec3& p = positions[rotated[i]];
+						const vec3& q = positions[rotated[(i + 1) % n]];
+						normal += cross(p - base, q - base);
+						longest = std::max(longest, dot(q - p, q - p));
+					}
+					float twice = length(normal);
+					drop = twice < 2.0f * options.degenerateArea || twice <= DEGENERATE_RATIO * longest;
+				}
+				if (drop) ++degenerate;
+			}
+			if (!drop && options.removeDuplicateFaces && n > 0 && !seen.insert(&rotated[0], n)) {
+				drop = true;
+				++duplicates;
+			}
+			if (drop) continue;
+		}
+		if (out) {
+			out->write(row, len);
+			out->put('\n');
+		}
+	}
+	source.rewind();
+	if (report) {
+		if (options.removeDegenerate) report->add("Degenerate f", degenerate);
+		if (options.removeDuplicateFaces) report->add("Duplicate f", duplicates);
+	}
+	if (out) {
+		out->flush();
+		if (!out->good()) {
+			error = "Failed to write output for " + source.name();
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace objmagic
@@ -0,0 +1,23 @@
+#pragma once
+
+// Removal of faces that draw nothing new: degenerate ones and duplicates
+
+#include <string>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Streams the source to out without the faces options ask to remove, or only counts them if
+// out is null, adding the counts to the report.
+//
+// With removeDegenerate, a face is degenerate if it uses a vertex twice, has less area than
+// degenerateArea, or is thinner than float rounding next to its longest edge. Checking the area
+// keeps the positions of the vertices in memory, 12 bytes each.
+// With removeDuplicateFaces, a face using the same vertices as an earlier one, in the same
+// order and winding but starting from any corner, is a duplicate. Faces are compared by
+// their vertex indices, rotated to start from the lowest one and hashed, and every kept face
+// is remembered for that, taking about twice its indices in memory.
+bool removeRedundantFaces(Source& source, Sink* out, const Options& options, std::string& error, Report* report);
+
+} // namespace objmagic
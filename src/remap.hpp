@@ -0,0 +1,37 @@
+#pragma once
+
+// Renumbering of elements after some of them are removed. The new index of a kept
+// element is the number of kept elements before it, found from a prefix sum of
+// popcounts per 64-bit word, so the table costs one bit per element on top of the flags.
+
+#include <cstdint>
+
+#include "bitset.hpp"
+
+class Remap {
+public:
+	// Keeps the elements whose bit is set
+	explicit Remap(const Bitset& keep, Arena* arena = nullptr):
+		keep(keep), ranks(ArenaAllocator<uint64_t>(arena))
+	{
+		size_t words = (keep.size() + 63) / 64;
+		ranks.resize(words + 1);
+		ranks[0] = 0;
+		for (size_t i = 0; i < words; ++i)
+			ranks[i + 1] = ranks[i] + __builtin_popcountll(keep.data()[i]);
+	}
+
+	bool kept(uint64_t i) const { return keep.test(i); }
+	// Kept elements before i, i.e. the new index of i if it is kept
+	uint64_t operator()(uint64_t i) const {
+		uint64_t below = keep.data()[i >> 6] & ((1ull << (i & 63)) - 1);
+		return ranks[i >> 6] + __builtin_popcountll(below);
+	}
+	uint64_t size() const { return keep.size(); }
+	uint64_t keptCount() const { return ranks.back(); }
+	uint64_t removedCount() const { return size() - keptCount(); }
+
+private:
+	const Bitset& keep;
+	Array<uint64_t> ranks;
+};
@@ -0,0 +1,560 @@
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+
+#include "../glm/geometric.hpp"
+#include "simplify.hpp"
+#include "quadric.hpp"
+#include "triangulate.hpp"
+#include "threadpool.hpp"
+#include "vecmath.hpp"
+
+#define SIMPLIFY_PART_TRIANGLES (1 << 18) // Triangles per part simplified in parallel
+#define SIMPLIFY_BORDER_WEIGHT 2.0   // Of the planes through borders, relative to those of triangles
+#define SIMPLIFY_UV_WEIGHT 1.0       // Of squared tex coord differences, in a mesh scaled to unit size
+#define SIMPLIFY_NORMAL_WEIGHT 0.01  // Of squared normal differences
+#define SIMPLIFY_PASS_ERROR 1.5      // Collapses in a pass may cost this much more than the goal's
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+std::string format(double value) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%.3g", value);
+	return tmp;
+}
+
+// Triangles of the mesh as they are simplified
+struct Triangles {
+	std::vector<Index> faces;     // Face of each triangle
+	std::vector<Index> v, vt, vn; // Per corner
+	std::vector<uint32_t> materials; // Of each triangle, numbered by name
+	std::vector<uint8_t> dead, changed;
+	std::vector<vec3> positions;  // Of the vertices, scaled to unit size
+	std::vector<Quadric> quadrics;
+	std::vector<uint8_t> shared;  // Vertices in more than one part
+};
+
+enum VertexKind : uint8_t { KindUnknown, KindInterior, KindBorder, KindLocked };
+
+// Triangles simplified together, with their vertices numbered locally
+struct Part {
+	std::vector<Index> triangles; // Global triangle numbers
+	std::vector<Index> globals;   // Local vertex to global one
+	std::vector<Index> v, vt, vn; // Per corner, v local
+	std::vector<uint32_t> materials;
+	std::vector<uint8_t> dead;
+	std::vector<uint8_t> locked;  // Vertices other parts use, or on degenerate triangles
+	std::vector<vec3> positions;
+	std::vector<Quadric> quadrics;
+	size_t collapses = 0;
+	double error = 0.0; // Largest quadric error of a collapse
+};
+
+void loadPart(const Triangles& all, Part& part) {
+	size_t count = part.triangles.size();
+	part.v.resize(count * 3);
+	part.vt.resize(count * 3);
+	part.vn.resize(count * 3);
+	part.materials.resize(count);
+	part.globals.clear();
+	for (size_t i = 0; i < count; ++i)
+		for (int k = 0; k < 3; ++k)
+			part.globals.push_back(all.v[part.triangles[i] * 3 + k]);
+	std::sort(part.globals.begin(), part.globals.end());
+	part.globals.erase(std::unique(part.globals.begin(), part.globals.end()), part.globals.end());
+	size_t vertices = part.globals.size();
+	part.locked.assign(vertices, 0);
+	part.positions.resize(vertices);
+	part.quadrics.resize(vertices);
+	for (size_t i = 0; i < vertices; ++i) {
+		Index g = part.globals[i];
+		part.locked[i] = all.shared[g];
+		part.positions[i] = all.positions[g];
+		part.quadrics[i] = all.quadrics[g];
+	}
+	for (size_t i = 0; i < count; ++i) {
+		part.materials[i] = all.materials[part.triangles[i]];
+		Index* corners = &part.v[i * 3];
+		for (int k = 0; k < 3; ++k) {
+			Index c = part.triangles[i] * 3 + k;
+			corners[k] = std::lower_bound(part.globals.begin(), part.globals.end(), all.v[c]) - part.globals.begin();
+			part.vt[i * 3 + k] = all.vt[c];
+			part.vn[i * 3 + k] = all.vn[c];
+		}
+		if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+			part.locked[corners[0]] = part.locked[corners[1]] = part.locked[corners[2]] = 1;
+	}
+	part.dead.assign(count, 0);
+}
+
+void storePart(const Part& part, Triangles& all) {
+	for (size_t i = 0; i < part.triangles.size(); ++i) {
+		Index t = part.triangles[i];
+		if (part.dead[i]) {
+			all.dead[t] = 1;
+			continue;
+		}
+		for (int k = 0; k < 3; ++k) {
+			Index c = t * 3 + k, local = i * 3 + k;
+			Index v = part.globals[part.v[local]];
+			if (all.v[c] == v && all.vt[c] == part.vt[local] && all.vn[c] == part.vn[local]) continue;
+			all.v[c] = v;
+			all.vt[c] = part.vt[local];
+			all.vn[c] = part.vn[local];
+			all.changed[t] = 1;
+		}
+	}
+	// Shared vertices are left alone, so only their own part changes the others
+	for (size_t i = 0; i < part.globals.size(); ++i)
+		if (!part.locked[i]) all.quadrics[part.globals[i]] = part.quadrics[i];
+}
+
+class Collapser {
+public:
+	Collapser(const Mesh& mesh, Part& part): mesh(mesh), part(part) {}
+
+	void run(size_t target);
+
+private:
+	struct Candidate {
+		double cost;
+		Index from, to;
+		bool operator<(const Candidate& other) const { return cost < other.cost; }
+	};
+
+	bool sameAttributes(Index a, Index b) const;
+	VertexKind kind(Index u);
+	// Triangles around u that also use w
+	size_t shared(Index u, Index w) const;
+	// Corner of vertex u in triangle t
+	Index corner(Index t, Index u) const {
+		return part.v[t * 3] == u ? t * 3 : part.v[t * 3 + 1] == u ? t * 3 + 1 : part.v[t * 3 + 2] == u ? t * 3 + 2 : NoIndex;
+	}
+	// Pairs the attributes of the corners of u with those of w to take their place,
+	// adding up how much they differ
+	bool mapAttributes(Index u, Index w, double& cost);
+	bool evaluate(Index u, Index w, double& cost);
+	// Returns the number of triangles removed, 0 if the collapse can't be done
+	size_t collapse(Index u, Index w);
+	void neighbors(Index u, std::vector<Index>& out) const;
+
+	const Mesh& mesh;
+	Part& part;
+	std::vector<Index> offsets, adjacent; // CSR of live triangles around each vertex
+	std::vector<uint8_t> kinds, touched;
+	std::vector<uint8_t> uniform; // Vertices with the same attributes in all corners, once their kind is known
+	std::vector<std::pair<Index, Index>> pairs; // Corners of u and w
+	std::vector<Index> around, aroundOther;
+};
+
+bool Collapser::sameAttributes(Index a, Index b) const {
+	// Where materials meet is a seam as well
+	if (part.materials[a / 3] != part.materials[b / 3]) return false;
+	Index ta = part.vt[a], tb = part.vt[b], na = part.vn[a], nb = part.vn[b];
+	if (ta != tb && (ta == NoIndex || tb == NoIndex || mesh.tu[ta] != mesh.tu[tb] || mesh.tv[ta] != mesh.tv[tb]))
+		return false;
+	return na == nb || (na != NoIndex && nb != NoIndex && mesh.nx[na] == mesh.nx[nb] && mesh.ny[na] == mesh.ny[nb]
+		&& mesh.nz[na] == mesh.nz[nb]);
+}
+
+void Collapser::neighbors(Index u, std::vector<Index>& out) const {
+	out.clear();
+	for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+		Index t = adjacent[a];
+		if (part.dead[t]) continue;
+		for (int k = 0; k < 3; ++k)
+			if (part.v[t * 3 + k] != u) out.push_back(part.v[t * 3 + k]);
+	}
+	std::sort(out.begin(), out.end());
+}
+
+VertexKind Collapser::kind(Index u) {
+	if (kinds[u] != KindUnknown) return (VertexKind)kinds[u];
+	VertexKind result = KindLocked;
+	if (!part.locked[u]) {
+		// Every edge is used by two triangles inside the surface and one on a border
+		neighbors(u, around);
+		size_t borders = 0;
+		bool manifold = true;
+		for (size_t i = 0; i < around.size();) {
+			size_t j = i;
+			while (j < around.size() && around[j] == around[i]) ++j;
+			if (j - i == 1) ++borders;
+			else if (j - i > 2) manifold = false;
+			i = j;
+		}
+		if (manifold && borders == 0) result = KindInterior;
+		else if (manifold && borders == 2) result = KindBorder;
+		Index first = NoIndex;
+		uniform[u] = 1;
+		for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+			Index t = adjacent[a];
+			if (part.dead[t]) continue;
+			Index c = corner(t, u);
+			if (first == NoIndex) first = c;
+			else if (part.vt[c] != part.vt[first] || part.vn[c] != part.vn[first]
+				|| part.materials[t] != part.materials[first / 3]) uniform[u] = 0;
+		}
+	}
+	kinds[u] = result;
+	return result;
+}
+
+size_t Collapser::shared(Index u, Index w) const {
+	size_t count = 0;
+	for (Index a = offsets[u]; a < offsets[u + 1]; ++a)
+		if (!part.dead[adjacent[a]] && corner(adjacent[a], w) != NoIndex) ++count;
+	return count;
+}
+
+bool Collapser::mapAttributes(Index u, Index w, double& cost) {
+	pairs.clear();
+	for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+		Index t = adjacent[a], cw = corner(t, w);
+		if (cw == NoIndex || part.dead[t]) continue;
+		Index cu = corner(t, u);
+		bool known = false;
+		for (const auto& pair : pairs) {
+			if (!sameAttributes(pair.first, cu)) continue;
+			if (!sameAttributes(pair.second, cw)) return false; // Two sides of a seam meet here
+			known = true;
+			break;
+		}
+		if (!known) pairs.emplace_back(cu, cw);
+	}
+	// The other corners of u need something to take their place, which they don't if the
+	// collapse leaves a seam through u
+	for (Index a = offsets[u]; a < offsets[u + 1] && !uniform[u]; ++a) {
+		Index t = adjacent[a];
+		if (part.dead[t] || corner(t, w) != NoIndex) continue;
+		Index cu = corner(t, u);
+		bool known = false;
+		for (const auto& pair : pairs)
+			if ((known = sameAttributes(pair.first, cu))) break;
+		if (!known) return false;
+	}
+	cost = 0.0;
+	for (const auto& pair : pairs) {
+		Index ta = part.vt[pair.first], tb = part.vt[pair.second];
+		if (ta != NoIndex && tb != NoIndex) {
+			double du = mesh.tu[ta] - mesh.tu[tb], dv = mesh.tv[ta] - mesh.tv[tb];
+			cost += SIMPLIFY_UV_WEIGHT * (du * du + dv * dv);
+		}
+		Index na = part.vn[pair.first], nb = part.vn[pair.second];
+		if (na != NoIndex && nb != NoIndex) {
+			vec3 d = vec3(mesh.nx[na], mesh.ny[na], mesh.nz[na]) - vec3(mesh.nx[nb], mesh.ny[nb], mesh.nz[nb]);
+			cost += SIMPLIFY_NORMAL_WEIGHT * dot(d, d);
+		}
+	}
+	return true;
+}
+
+bool Collapser::evaluate(Index u, Index w, double& cost) {
+	// Locked vertices may have triangles in other parts, which collapses into them would
+	// have to be checked against
+	VertexKind k = kind(u);
+	if (k == KindLocked || part.locked[w] || (k == KindBorder && shared(u, w) != 1)) return false;
+	if (!mapAttributes(u, w, cost)) return false;
+	Quadric q = part.quadrics[u];
+	q += part.quadrics[w];
+	cost += q.error(part.positions[w]);
+	return true;
+}
+
+size_t Collapser::collapse(Index u, Index w) {
+	// The vertices next to both must be the ones across the edge, or the surface would fold
+	neighbors(u, around);
+	around.erase(std::unique(around.begin(), around.end()), around.end());
+	neighbors(w, aroundOther);
+	aroundOther.erase(std::unique(aroundOther.begin(), aroundOther.end()), aroundOther.end());
+	size_t common = 0;
+	for (size_t i = 0, j = 0; i < around.size() && j < aroundOther.size();) {
+		if (around[i] < aroundOther[j]) ++i;
+		else if (around[i] > aroundOther[j]) ++j;
+		else {
+			++common;
+			++i;
+			++j;
+		}
+	}
+	size_t removed = shared(u, w);
+	if (common != removed) return 0;
+
+	// No triangle may turn over
+	const vec3& to = part.positions[w];
+	for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+		Index t = adjacent[a];
+		if (part.dead[t] || corner(t, w) != NoIndex) continue;
+		Index c = corner(t, u) - t * 3;
+		const vec3& p1 = part.positions[part.v[t * 3 + (c + 1) % 3]];
+		const vec3& p2 = part.positions[part.v[t * 3 + (c + 2) % 3]];
+		vec3 before = cross(p1 - part.positions[u], p2 - part.positions[u]);
+		vec3 after = cross(p1 - to, p2 - to);
+		if (dot(before, after) <= 0.0f) return 0;
+	}
+
+	double cost;
+	if (!mapAttributes(u, w, cost)) return 0;
+	for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+		Index t = adjacent[a];
+		if (part.dead[t]) continue;
+		if (corner(t, w) != NoIndex) {
+			part.dead[t] = 1;
+			continue;
+		}
+		Index c = corner(t, u);
+		for (const auto& pair : pairs) {
+			if (!sameAttributes(pair.first, c)) continue;
+			part.v[c] = w;
+			part.vt[c] = part.vt[pair.second];
+			part.vn[c] = part.vn[pair.second];
+			break;
+		}
+	}
+	// The triangles of u are now those of w, which the adjacency doesn't know until the
+	// next pass. Those around the other vertices just have a different corner.
+	touched[u] = touched[w] = 1;
+	part.quadrics[w] += part.quadrics[u];
+	part.error = std::max(part.error, part.quadrics[w].error(to));
+	++part.collapses;
+	return removed;
+}
+
+void Collapser::run(size_t target) {
+	size_t vertices = part.globals.size(), triangles = part.triangles.size();
+	size_t live = 0;
+	for (uint8_t dead : part.dead) live += !dead;
+	std::vector<Index> seen; // Vertex whose edges last went past this one
+	std::vector<Candidate> queue;
+	while (live > target) {
+		offsets.assign(vertices + 1, 0);
+		for (size_t t = 0; t < triangles; ++t)
+			if (!part.dead[t]) for (int k = 0; k < 3; ++k) ++offsets[part.v[t * 3 + k] + 1];
+		for (size_t v = 0; v < vertices; ++v) offsets[v + 1] += offsets[v];
+		adjacent.resize(offsets[vertices]);
+		for (size_t t = 0; t < triangles; ++t)
+			if (!part.dead[t]) for (int k = 0; k < 3; ++k) adjacent[offsets[part.v[t * 3 + k]]++] = t;
+		for (size_t v = vertices; v > 0; --v) offsets[v] = offsets[v - 1];
+		offsets[0] = 0;
+		kinds.assign(vertices, KindUnknown);
+		uniform.assign(vertices, 0);
+		touched.assign(vertices, 0);
+
+		// The cheaper way to collapse each edge, found from its lower numbered vertex
+		queue.clear();
+		seen.assign(vertices, NoIndex);
+		for (Index u = 0; u < vertices; ++u) {
+			for (Index a = offsets[u]; a < offsets[u + 1]; ++a) {
+				for (int k = 0; k < 3; ++k) {
+					Index w = part.v[adjacent[a] * 3 + k];
+					if (w <= u || seen[w] == u) continue;
+					seen[w] = u;
+					double forward, backward;
+					bool canForward = evaluate(u, w, forward);
+					bool canBackward = evaluate(w, u, backward);
+					if (canForward && (!canBackward || forward <= backward))
+						queue.push_back(Candidate{ forward, u, w });
+					else if (canBackward)
+						queue.push_back(Candidate{ backward, w, u });
+				}
+			}
+		}
+		if (queue.empty()) break;
+
+		// Each collapse removes about two triangles. Those costing much more than needed to
+		// get there are left for later passes, where cheaper ones may have come up.
+		size_t goal = std::min(queue.size(), (live - target + 1) / 2);
+		std::nth_element(queue.begin(), queue.begin() + (goal - 1), queue.end());
+		double bound = queue[goal - 1].cost * SIMPLIFY_PASS_ERROR;
+		auto end = std::partition(queue.begin() + goal, queue.end(),
+			[bound](const Candidate& candidate) { return candidate.cost <= bound; });
+		std::sort(queue.begin(), end);
+		size_t collapsed = 0;
+		for (auto it = queue.begin(); it != end; ++it) {
+			const Candidate& candidate = *it;
+			if (live <= target) break;
+			if (touched[candidate.from] || touched[candidate.to]) continue;
+			size_t removed = collapse(candidate.from, candidate.to);
+			if (!removed) continue;
+			++collapsed;
+			live -= removed;
+		}
+		if (!collapsed) break;
+	}
+}
+
+} // namespace
+
+SimplifyStats simplify(Mesh& mesh, double target, ThreadPool& pool, Report* report) {
+	bool polygons = false;
+	for (size_t f = 0; f < mesh.faces.size() && !polygons; ++f)
+		polygons = mesh.faces.corners(f) > 3;
+	if (polygons) objmagic::triangulate(mesh, nullptr);
+
+	// Faces with fewer corners stay as they are
+	const Elements& faces = mesh.faces;
+	std::vector<uint32_t> materials(faces.size(), 0);
+	std::map<std::string, uint32_t> names;
+	for (const Range& range : mesh.materials) {
+		uint32_t id = names.emplace(range.name.str(), names.size() + 1).first->second;
+		std::fill(materials.begin() + range.first, materials.begin() + range.first + range.count, id);
+	}
+	Triangles all;
+	for (size_t f = 0; f < faces.size(); ++f) {
+		if (faces.corners(f) != 3) continue;
+		all.faces.push_back(f);
+		all.materials.push_back(materials[f]);
+		for (Index c = faces.offsets[f]; c < faces.offsets[f + 1]; ++c) {
+			all.v.push_back(faces.v[c]);
+			all.vt.push_back(faces.vt[c]);
+			all.vn.push_back(faces.vn[c]);
+		}
+	}
+	size_t count = all.faces.size();
+	SimplifyStats stats;
+	stats.before = count;
+	size_t goal = target > 1.0 ? std::min<size_t>(count, (size_t)target) : (size_t)std::llround(target * count);
+	all.dead.assign(count, 0);
+	all.changed.assign(count, 0);
+
+	// Positions scaled to unit size, so that errors are relative to it
+	size_t vertexCount = mesh.vertexCount();
+	vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < vertexCount; ++i) {
+		vec3 p(mesh.px[i], mesh.py[i], mesh.pz[i]);
+		lower = min(lower, p);
+		upper = max(upper, p);
+	}
+	float size = vertexCount ? std::max(std::max(upper.x - lower.x, upper.y - lower.y), upper.z - lower.z) : 0.0f;
+	float scale = size > 0.0f ? 1.0f / size : 1.0f;
+	all.positions.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+		all.positions[i] = (vec3(mesh.px[i], mesh.py[i], mesh.pz[i]) - lower) * scale;
+
+	// Planes of the triangles weighted by area, and planes standing on open borders, which
+	// are the edges no other triangle around their first vertex has
+	all.quadrics.assign(vertexCount, Quadric());
+	std::vector<Index> offsets(vertexCount + 1, 0), adjacent(count * 3);
+	for (Index v : all.v) ++offsets[v + 1];
+	for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] += offsets[v];
+	for (size_t c = 0; c < count * 3; ++c) adjacent[offsets[all.v[c]]++] = c / 3;
+	for (size_t v = vertexCount; v > 0; --v) offsets[v] = offsets[v - 1];
+	offsets[0] = 0;
+	for (size_t t = 0; t < count; ++t) {
+		const Index* v = &all.v[t * 3];
+		vec3 normal = cross(all.positions[v[1]] - all.positions[v[0]], all.positions[v[2]] - all.positions[v[0]]);
+		float length = glm::length(normal);
+		if (length == 0.0f) continue;
+		normal /= length;
+		Quadric q(normal, all.positions[v[0]], length * 0.5);
+		for (int k = 0; k < 3; ++k) {
+			all.quadrics[v[k]] += q;
+			Index a = v[k], b = v[(k + 1) % 3];
+			size_t sharing = 0;
+			for (Index i = offsets[a]; i < offsets[a + 1] && sharing < 2; ++i) {
+				const Index* other = &all.v[adjacent[i] * 3];
+				if (other[0] == b || other[1] == b || other[2] == b) ++sharing;
+			}
+			if (sharing != 1) continue;
+			vec3 pa = all.positions[a], pb = all.positions[b];
+			vec3 side = cross(pb - pa, normal);
+			float sideLength = glm::length(side);
+			if (sideLength == 0.0f) continue;
+			Quadric border(side / sideLength, pa, SIMPLIFY_BORDER_WEIGHT * dot(pb - pa, pb - pa));
+			all.quadrics[a] += border;
+			all.quadrics[b] += border;
+		}
+	}
+	std::vector<Index>().swap(offsets);
+	std::vector<Index>().swap(adjacent);
+
+	// Parts in Z-order of the triangle centroids, simplified in parallel with the vertices
+	// they share locked, then the whole mesh
+	all.shared.assign(vertexCount, 0);
+	size_t partCount = std::max<size_t>(1, count / SIMPLIFY_PART_TRIANGLES);
+	std::vector<Part> parts(partCount);
+	if (partCount > 1 && goal < count) {
+		std::vector<std::pair<uint32_t, Index>> keys(count);
+		for (size_t t = 0; t < count; ++t) {
+			const Index* v = &all.v[t * 3];
+			vec3 centroid = (all.positions[v[0]] + all.positions[v[1]] + all.positions[v[2]]) / 3.0f;
+			keys[t] = std::make_pair(mortonCode(centroid), (Index)t);
+		}
+		std::sort(keys.begin(), keys.end());
+		std::vector<uint32_t> owner(vertexCount, ~0u);
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t p = i * partCount / count;
+			parts[p].triangles.push_back(keys[i].second);
+			for (int k = 0; k < 3; ++k) {
+				Index v = all.v[keys[i].second * 3 + k];
+				if (owner[v] == ~0u) owner[v] = p;
+				else if (owner[v] != p) all.shared[v] = 1;
+			}
+		}
+		parallelFor(pool, partCount, 1, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				loadPart(all, parts[p]);
+				Collapser(mesh, parts[p]).run(goal * parts[p].triangles.size() / count);
+				storePart(parts[p], all);
+				Part done;
+				done.collapses = parts[p].collapses;
+				done.error = parts[p].error;
+				std::swap(parts[p], done);
+			}
+		});
+		all.shared.assign(vertexCount, 0);
+	}
+	Part whole;
+	for (size_t t = 0; t < count; ++t)
+		if (!all.dead[t]) whole.triangles.push_back(t);
+	loadPart(all, whole);
+	Collapser(mesh, whole).run(goal);
+	storePart(whole, all);
+
+	// Back into the mesh
+	Elements& result = mesh.faces;
+	Bitset removed;
+	removed.resize(faces.size());
+	for (size_t t = 0; t < count; ++t) {
+		Index f = all.faces[t];
+		if (all.dead[t]) {
+			removed.set(f);
+			continue;
+		}
+		if (!all.changed[t]) continue;
+		Index first = result.offsets[f];
+		for (int k = 0; k < 3; ++k) {
+			result.v[first + k] = all.v[t * 3 + k];
+			result.vt[first + k] = all.vt[t * 3 + k];
+			result.vn[first + k] = all.vn[t * 3 + k];
+		}
+		result.dirty.set(f);
+	}
+	double error = whole.error;
+	size_t collapses = whole.collapses;
+	for (const Part& part : parts) {
+		error = std::max(error, part.error);
+		collapses += part.collapses;
+	}
+	stats.after = count - removed.count();
+	stats.error = std::sqrt(error) * size;
+	if (removed.any()) mesh.removeFaces(removed);
+
+	if (report) {
+		report->add("Simplified", std::to_string(stats.before) + " -> " + std::to_string(stats.after) + " triangles");
+		report->add("Collapses", collapses);
+		report->add("Max error", format(stats.error) + " (" + format(size > 0.0f ? 100.0 * stats.error / size : 0.0) + "% of size)");
+		if (partCount > 1) report->add("Parts", partCount);
+	}
+	return stats;
+}
+
+} // namespace objmagic
@@ -0,0 +1,31 @@
+#pragma once
+
+// Reduction of the triangle count by collapsing edges in order of quadric error
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+struct SimplifyStats {
+	size_t before = 0, after = 0; // Triangles
+	double error = 0.0;           // Largest distance a collapse moved the surface, roughly
+};
+
+// Collapses edges into one of their vertices until at most target triangles are left, if
+// target is above 1, or else that fraction of them. Polygons are triangulated first.
+//
+// The cost of a collapse is the quadric error (Garland and Heckbert) of the surface around
+// both vertices, with open borders weighted in, plus how much the texture coordinates and
+// normals of the removed vertex differ from those of the one kept. A vertex on a texture,
+// normal or material seam only moves along the seam, a border vertex only along the border,
+// and collapses that would make the surface non-manifold or flip triangles are skipped.
+//
+// Collapses are done in passes: each builds the vertex to triangle adjacency in CSR form,
+// queues the cheapest collapse of every edge and does them in order, skipping those around
+// vertices already changed in the pass. Large meshes are first cut into spatially coherent
+// parts that are simplified in parallel with the vertices they share locked, and then the
+// whole mesh is simplified together to reach the target.
+SimplifyStats simplify(Mesh& mesh, double target, ThreadPool& pool, Report* report);
+
+} // namespace objmagic
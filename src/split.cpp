@@ -0,0 +1,343 @@
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+
+#include "split.hpp"
+#include "filter.hpp"
+#include "parse.hpp"
+#include "mesh.hpp"
+
+#define SPLIT_FLUSH (64 << 10)   // Bytes buffered per output before writing it out
+#define SPLIT_MAX_HANDLES 256
+
+namespace objmagic {
+
+namespace {
+
+static const uint32_t NoOutput = ~0u;
+
+inline bool startsWith(const char* row, size_t len, const char* prefix) {
+	size_t prefixLen = strlen(prefix);
+	return len >= prefixLen && memcmp(row, prefix, prefixLen) == 0;
+}
+
+// Characters safe in file names, anything else becomes '_'
+std::string fileName(const std::string& name) {
+	std::string result = name.empty() ? "default" : name;
+	for (char& c : result) {
+		bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+			|| c == '-' || c == '_' || c == '.';
+		if (!safe) c = '_';
+	}
+	return result;
+}
+
+void appendNumber(std::string& out, uint64_t value) {
+	char tmp[24];
+	char* p = tmp + sizeof(tmp);
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	out.append(p, tmp + sizeof(tmp) - p);
+}
+
+enum StateKind { StateObject, StateGroup, StateMaterial, StateSmoothing, StateKinds };
+
+struct Output {
+	std::string path;
+	std::string buffer;
+	bool created = false;  // The file exists, so later writes append to it
+	int handle = -1;       // Slot in the handle pool, -1 if not open
+	uint64_t counts[3] = {}; // v, vt and vn written
+	// Local indices of attributes first used by another output, see Splitter::local
+	std::unordered_map<uint64_t, uint64_t> shared[3];
+	std::string state[StateKinds]; // o, g, usemtl and s records in effect in the file
+};
+
+// Outputs and the files they are written to. Only a limited number of files is open at a
+// time, the least recently written one is closed to make room for another.
+class OutputPool {
+public:
+	explicit OutputPool(size_t bufferSize): bufferSize(bufferSize) {
+		struct rlimit limit;
+		size_t handles = SPLIT_MAX_HANDLES;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 2 < handles)
+			handles = limit.rlim_cur / 2;
+		slots.resize(handles ? handles : 1);
+	}
+	~OutputPool() {
+		for (Slot& slot : slots)
+			if (slot.file) fclose(slot.file);
+	}
+
+	std::vector<Output> outputs;
+
+	// Call after appending to the buffer of output i
+	bool wrote(uint32_t i, size_t bytes, std::string& error) {
+		buffered += bytes;
+		if (outputs[i].buffer.size() >= SPLIT_FLUSH && !flush(i, error)) return false;
+		if (buffered < bufferSize) return true;
+		return flushAll(error);
+	}
+
+	bool flushAll(std::string& error) {
+		for (uint32_t i = 0; i < outputs.size(); ++i)
+			if (!flush(i, error)) return false;
+		return true;
+	}
+
+	bool close(std::string& error) {
+		if (!flushAll(error)) return false;
+		for (Slot& slot : slots) {
+			if (slot.file && fclose(slot.file) != 0) {
+				slot.file = nullptr;
+				error = "Failed to write " + outputs[slot.owner].path;
+				return false;
+			}
+			slot.file = nullptr;
+		}
+		return true;
+	}
+
+	size_t filesOpened() const { return opened; }
+
+private:
+	struct Slot {
+		FILE* file = nullptr;
+		uint32_t owner = NoOutput;
+		uint64_t lastUse = 0;
+	};
+
+	bool flush(uint32_t i, std::string& error) {
+		Output& output = outputs[i];
+		if (output.buffer.empty()) return true;
+		if (output.handle < 0) {
+			// A free slot, or else the least recently used one
+			size_t victim = 0;
+			for (size_t s = 0; s < slots.size(); ++s) {
+				if (!slots[s].file) { victim = s; break; }
+				if (slots[s].lastUse < slots[victim].lastUse) victim = s;
+			}
+			Slot& slot = slots[victim];
+			if (slot.file) {
+				outputs[slot.owner].handle = -1;
+				if (fclose(slot.file) != 0) {
+					slot.file = nullptr;
+					error = "Failed to write " + outputs[slot.owner].path;
+					return false;
+				}
+			}
+			slot.file = fopen(output.path.c_str(), output.created ? "ab" : "wb");
+			if (!slot.file) {
+				error = "Failed to open file " + output.path + " for output";
+				return false;
+			}
+			slot.owner = i;
+			output.created = true;
+			output.handle = victim;
+			++opened;
+		}
+		Slot& slot = slots[output.handle];
+		slot.lastUse = ++clock;
+		if (fwrite(output.buffer.data(), 1, output.buffer.size(), slot.file) != output.buffer.size()) {
+			error = "Failed to write " + output.path;
+			return false;
+		}
+		buffered -= output.buffer.size();
+		std::string().swap(output.buffer);
+		return true;
+	}
+
+	size_t bufferSize;
+	size_t buffered = 0; // Bytes in all buffers
+	std::vector<Slot> slots;
+	uint64_t clock = 0;
+	size_t opened = 0;
+};
+
+class Splitter {
+public:
+	Splitter(const std::string& base, SplitMode mode, size_t bufferSize):
+		base(base), key(mode == SplitObject ? StateObject : mode == SplitGroup ? StateGroup : StateMaterial),
+		pool(bufferSize)
+	{}
+
+	bool run(Source& source, std::string& error, Report* report);
+
+private:
+	// The output for elements under the current records, created on first use
+	bool currentOutput(uint32_t& o, std::string& error);
+	// Index of attribute i of the kind in output o, writing the attribute there on first use.
+	// Most attributes belong to a single output, which is tracked in flat arrays, the rest
+	// are looked up in the output's own table.
+	uint64_t local(Output& output, uint32_t o, int kind, uint64_t i);
+	void writeRow(Output& output, const std::string& row) {
+		output.buffer += row;
+		output.buffer += '\n';
+	}
+
+	std::string base;
+	StateKind key;
+	OutputPool pool;
+	std::unordered_map<std::string, uint32_t> outputIds;
+	std::set<std::string> paths;
+	uint32_t current = NoOutput;
+
+	std::string state[StateKinds];
+	std::vector<std::string> headers; // mtllib records
+
+	Arena arena; // Attribute records
+	std::vector<Text> attributes[3];
+	std::vector<uint32_t> owner[3];
+	std::vector<Index> ownerIndex[3];
+};
+
+bool Splitter::currentOutput(uint32_t& o, std::string& error) {
+	if (current != NoOutput) {
+		o = current;
+		return true;
+	}
+	std::string name = state[key].empty() ? "" : recordName(state[key].data(), state[key].size(),
+		key == StateMaterial ? 6 : 1);
+	auto it = outputIds.find(name);
+	if (it != outputIds.end()) {
+		o = current = it->second;
+		return true;
+	}
+
+	std::string path = base + "_" + fileName(name) + ".obj";
+	for (int n = 2; paths.count(path); ++n)
+		path = base + "_" + fileName(name) + "_" + std::to_string(n) + ".obj";
+	paths.insert(path);
+	current = pool.outputs.size();
+	outputIds.emplace(name, current);
+	pool.outputs.emplace_back();
+	Output& output = pool.outputs.back();
+	output.path = path;
+	for (const std::string& header : headers)
+		writeRow(output, header);
+	o = current;
+	return pool.wrote(o, output.buffer.size(), error);
+}
+
+uint64_t Splitter::local(Output& output, uint32_t o, int kind, uint64_t i) {
+	static const char* const keywords[3] = { "v ", "vt ", "vn " };
+	uint32_t& first = owner[kind][i];
+	if (first == o) return ownerIndex[kind][i];
+	if (first != NoOutput) {
+		auto it = output.shared[kind].find(i);
+		if (it != output.shared[kind].end()) return it->second;
+	}
+	uint64_t index = ++output.counts[kind];
+	if (first == NoOutput) {
+		first = o;
+		ownerIndex[kind][i] = index;
+	} else output.shared[kind].emplace(i, index);
+	const Text& text = attributes[kind][i];
+	output.buffer += keywords[kind];
+	output.buffer.append(text.data, text.size);
+	output.buffer += '\n';
+	return index;
+}
+
+bool Splitter::run(Source& source, std::string& error, Report* report) {
+	ElementCounts sofar;
+	std::vector<uint64_t> tuples(3 * 64);
+	std::string element;
+	uint64_t line = 0;
+	const char* row;
+	size_t len;
+	while (source.readLine(row, len)) {
+		++line;
+		if (len < 2) continue;
+		int kind = row[1] == ' ' ? 0 : row[1] == 't' ? 1 : row[1] == 'n' ? 2 : -1;
+		if (row[0] == 'v' && kind >= 0 && (kind == 0 || (len >= 3 && row[2] == ' '))) {
+			// Keep the values as they are, without the keyword
+			size_t skip = kind == 0 ? 2 : 3;
+			char* copy = (char*)arena.allocate(len - skip, 1);
+			memcpy(copy, row + skip, len - skip);
+			attributes[kind].push_back(Text{ copy, (uint32_t)(len - skip) });
+			owner[kind].push_back(NoOutput);
+			ownerIndex[kind].push_back(0);
+			++(kind == 0 ? sofar.v : kind == 1 ? sofar.vt : sofar.vn);
+			continue;
+		}
+		if (row[1] == ' ' && (row[0] == 'f' || row[0] == 'l' || row[0] == 'p')) {
+			int n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], tuples.size() / 3);
+			if (n > (int)tuples.size() / 3) {
+				tuples.resize(3 * n);
+				n = parseIndexTuples<uint64_t>(row + 2, row + len, sofar, &tuples[0], n);
+			}
+			if (n < 0) {
+				error = "Malformed element in " + source.name() + " line " + std::to_string(line);
+				return false;
+			}
+			uint32_t o;
+			if (!currentOutput(o, error)) return false;
+			Output& output = pool.outputs[o];
+			size_t before = output.buffer.size();
+			static const char* const resets[StateKinds] = { "", "g default", "", "s off" };
+			for (int k = 0; k < StateKinds; ++k) {
+				if (output.state[k] == state[k]) continue;
+				output.state[k] = state[k];
+				if (!state[k].empty() || *resets[k]) writeRow(output, state[k].empty() ? resets[k] : state[k]);
+			}
+			element.assign(row, 2);
+			const uint64_t counts[3] = { sofar.v, sofar.vt, sofar.vn };
+			for (int i = 0; i < n; ++i) {
+				uint64_t* tuple = &tuples[i * 3];
+				for (int k = 0; k < 3; ++k) {
+					if (tuple[k] != noIndex<uint64_t>() && tuple[k] >= counts[k]) {
+						error = "Index out of range in " + source.name() + " line " + std::to_string(line);
+						return false;
+					}
+				}
+				if (i) element += ' ';
+				appendNumber(element, local(output, o, 0, tuple[0]));
+				if (tuple[1] != noIndex<uint64_t>() || tuple[2] != noIndex<uint64_t>()) element += '/';
+				if (tuple[1] != noIndex<uint64_t>()) appendNumber(element, local(output, o, 1, tuple[1]));
+				if (tuple[2] != noIndex<uint64_t>()) {
+					element += '/';
+					appendNumber(element, local(output, o, 2, tuple[2]));
+				}
+			}
+			writeRow(output, element);
+			if (!pool.wrote(o, output.buffer.size() - before, error)) return false;
+			continue;
+		}
+		StateKind changed = startsWith(row, len, "o ") ? StateObject : startsWith(row, len, "g ") ? StateGroup
+			: startsWith(row, len, "usemtl ") ? StateMaterial : startsWith(row, len, "s ") ? StateSmoothing : StateKinds;
+		if (changed != StateKinds) {
+			state[changed].assign(row, len);
+			if (changed == key) current = NoOutput;
+		} else if (startsWith(row, len, "mtllib ")) {
+			headers.emplace_back(row, len);
+			for (uint32_t o = 0; o < pool.outputs.size(); ++o) {
+				writeRow(pool.outputs[o], headers.back());
+				if (!pool.wrote(o, len + 1, error)) return false;
+			}
+		}
+	}
+	source.rewind();
+	if (!pool.close(error)) return false;
+	if (report) {
+		report->add("Output files", pool.outputs.size());
+		if (pool.filesOpened() > pool.outputs.size()) report->add("Reopened", pool.filesOpened() - pool.outputs.size());
+	}
+	return true;
+}
+
+} // namespace
+
+bool splitBy(Source& source, const std::string& base, SplitMode mode, size_t bufferSize,
+	std::string& error, Report* report)
+{
+	Splitter splitter(base, mode, bufferSize);
+	return splitter.run(source, error, report);
+}
+
+} // namespace objmagic
@@ -0,0 +1,21 @@
+#pragma once
+
+// Splitting a model into one file per object, group or material
+
+#include <string>
+
+#include "objmagic.hpp"
+
+namespace objmagic {
+
+// Writes the elements under each o, g or usemtl record (per mode) to base_NAME.obj in a single
+// pass over the source. Every file gets the v, vt and vn records its elements use, numbered
+// from 1 in order of first use and written just before the first element using them, along
+// with the mtllib records and the o, g, usemtl and s records its elements are under.
+// Elements before any such record go to base_default.obj. Comments and other records are
+// left out. Attribute records are kept in memory until the end, output is buffered per file
+// and written through a pool of open handles, so there can be more files than descriptors.
+bool splitBy(Source& source, const std::string& base, SplitMode mode, size_t bufferSize,
+	std::string& error, Report* report);
+
+} // namespace objmagic
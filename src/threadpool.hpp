@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Fixed size pool of worker threads. Tasks receive the index of the worker
+// running them, so callers can keep per-worker scratch state without locking.
+class ThreadPool {
+public:
+	typedef std::function<void(unsigned worker)> Task;
+
+	explicit ThreadPool(unsigned threads = 0) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned i = 0; i < threads; ++i)
+			workers.emplace_back([this, i]() { work(i); });
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeup.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned size() const { return workers.size(); }
+
+	void enqueue(Task task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(std::move(task));
+			++pending;
+		}
+		wakeup.notify_one();
+	}
+
+	// Block until every queued task has finished
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return pending == 0; });
+	}
+
+private:
+	void work(unsigned index) {
+		for (;;) {
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty()) return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task(index);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0) done.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::deque<Task> tasks;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::condition_variable done;
+	size_t pending = 0;
+	bool stopping = false;
+};
+
+// Runs body(begin, end) over consecutive chunks of [0, count) on the pool. Small inputs (at
+// most grain elements) run inline on the calling thread. The calling thread works on chunks
+// too and only waits for the chunks other workers have started, so this can be called from
+// a task running on the same pool and doesn't wait for unrelated tasks.
+template<typename Body>
+void parallelFor(ThreadPool& pool, size_t count, size_t grain, Body body) {
+	if (count <= grain) {
+		body(size_t(0), count);
+		return;
+	}
+	struct State {
+		std::atomic<size_t> next{0};
+		size_t done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	size_t chunks = std::min<size_t>(pool.size() * 4, (count + grain - 1) / grain);
+	size_t chunk = (count + chunks - 1) / chunks;
+	chunks = (count + chunk - 1) / chunk;
+	// Helpers that start after every chunk was taken return without touching body
+	std::shared_ptr<State> state = std::make_shared<State>();
+	auto run = [state, &body, count, chunk, chunks]() {
+		for (size_t c; (c = state->next++) < chunks;) {
+			body(c * chunk, std::min(count, (c + 1) * chunk));
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (++state->done == chunks) state->finished.notify_all();
+		}
+	};
+	size_t helpers = std::min<size_t>(pool.size(), chunks - 1);
+	for (size_t i = 0; i < helpers; ++i)
+		pool.enqueue([run](unsigned) { run(); });
+	run();
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&]() { return state->done == chunks; });
+}
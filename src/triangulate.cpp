@@ -0,0 +1,236 @@
+#include <cmath>
+
+#include "../glm/geometric.hpp"
+#include "triangulate.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+// Normal of a possibly non-planar polygon (Newell's method), not normalized
+vec3 polygonNormal(const vec3* corners, size_t count) {
+	vec3 normal(0.0f);
+	for (size_t i = 0; i < count; ++i) {
+		const vec3& a = corners[i];
+		const vec3& b = corners[(i + 1) % count];
+		normal.x += (a.y - b.y) * (a.z + b.z);
+		normal.y += (a.z - b.z) * (a.x + b.x);
+		normal.z += (a.x - b.x) * (a.y + b.y);
+	}
+	return normal;
+}
+
+void fan(size_t first, size_t count, std::vector<uint32_t>& out) {
+	for (size_t i = 1; i + 1 < count; ++i) {
+		out.push_back(first);
+		out.push_back(first + i);
+		out.push_back(first + i + 1);
+	}
+}
+
+inline float cross2(const vec2& a, const vec2& b, const vec2& c) {
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+void earClip(const std::vector<vec2>& points, std::vector<uint32_t>& out) {
+	std::vector<uint32_t> remaining(points.size());
+	for (size_t i = 0; i < points.size(); ++i) remaining[i] = i;
+
+	auto isEar = [&](size_t k) {
+		size_t n = remaining.size();
+		const vec2& a = points[remaining[(k + n - 1) % n]];
+		const vec2& b = points[remaining[k]];
+		const vec2& c = points[remaining[(k + 1) % n]];
+		if (cross2(a, b, c) <= 0.0f) return false;
+		for (size_t j = 0; j < n; ++j) {
+			if (j == k || j == (k + 1) % n || j == (k + n - 1) % n) continue;
+			const vec2& p = points[remaining[j]];
+			if (p == a || p == b || p == c) continue;
+			if (cross2(a, b, p) >= 0.0f && cross2(b, c, p) >= 0.0f && cross2(c, a, p) >= 0.0f) return false;
+		}
+		return true;
+	};
+
+	while (remaining.size() > 3) {
+		size_t n = remaining.size();
+		size_t ear = n;
+		for (size_t k = 0; k < n && ear == n; ++k)
+			if (isEar(k)) ear = k;
+		if (ear == n) break; // Self-intersecting, fan what is left
+		out.push_back(remaining[(ear + n - 1) % n]);
+		out.push_back(remaining[ear]);
+		out.push_back(remaining[(ear + 1) % n]);
+		remaining.erase(remaining.begin() + ear);
+	}
+	for (size_t i = 1; i + 1 < remaining.size(); ++i) {
+		out.push_back(remaining[0]);
+		out.push_back(remaining[i]);
+		out.push_back(remaining[i + 1]);
+	}
+}
+
+} // namespace
+
+void triangulatePolygon(const vec3* corners, size_t count, std::vector<uint32_t>& out) {
+	if (count < 3) return;
+	vec3 normal = polygonNormal(corners, count);
+	bool convex = true;
+	for (size_t i = 0; i < count && convex; ++i) {
+		const vec3& a = corners[(i + count - 1) % count];
+		const vec3& b = corners[i];
+		const vec3& c = corners[(i + 1) % count];
+		convex = dot(cross(b - a, c - b), normal) >= 0.0f;
+	}
+
+	if (convex && count == 4) {
+		if (distance(corners[0], corners[2]) <= distance(corners[1], corners[3])) {
+			out.insert(out.end(), { 0, 1, 2, 0, 2, 3 });
+		} else {
+			out.insert(out.end(), { 0, 1, 3, 1, 2, 3 });
+		}
+		return;
+	}
+	if (convex || count == 3) {
+		fan(0, count, out);
+		return;
+	}
+
+	// Project to the plane of the two axes the normal is least aligned with,
+	// flipping one so that the polygon winds counterclockwise
+	vec3 n = abs(normal);
+	int drop = n.x > n.y ? (n.x > n.z ? 0 : 2) : (n.y > n.z ? 1 : 2);
+	int u = (drop + 1) % 3, v = (drop + 2) % 3;
+	float sign = normal[drop] < 0.0f ? -1.0f : 1.0f;
+	std::vector<vec2> points(count);
+	for (size_t i = 0; i < count; ++i)
+		points[i] = vec2(corners[i][u], corners[i][v] * sign);
+	earClip(points, out);
+}
+
+bool FaceTriangulator::write(const char* indexRow, size_t indexLen, const char* row, size_t len, const ElementCounts& sofar, Sink& out) {
+	// Corner tokens and the trailing comment of the row to output
+	tokens.clear();
+	const char* p = row + 2;
+	const char* end = row + len;
+	while (p < end && *p != '#') {
+		while (p < end && detail::isBlank(*p)) ++p;
+		if (p >= end || *p == '#') break;
+		const char* token = p;
+		while (p < end && !detail::isBlank(*p) && *p != '#') ++p;
+		tokens.emplace_back(token, p - token);
+	}
+	if (tokens.size() <= 3) {
+		out.write(row, len);
+		out.put('\n');
+		return true;
+	}
+
+	if (tuples.size() < 3 * tokens.size()) tuples.resize(3 * tokens.size());
+	int n = parseIndexTuples<uint64_t>(indexRow + 2, indexRow + indexLen, sofar, &tuples[0], tuples.size() / 3);
+	if (n != (int)tokens.size()) return false;
+	corners.resize(n);
+	bool known = true;
+	for (int i = 0; i < n; ++i) {
+		uint64_t v = tuples[i * 3];
+		known = known && v < positions.size();
+		corners[i] = known ? positions[v] : vec3(0.0f);
+	}
+	triangles.clear();
+	if (known) triangulatePolygon(&corners[0], n, triangles);
+	else fan(0, n, triangles); // Refers to vertices further in the file
+
+	for (size_t t = 0; t < triangles.size(); t += 3) {
+		out.put('f');
+		for (int k = 0; k < 3; ++k) {
+			out.put(' ');
+			out.write(tokens[triangles[t + k]].first, tokens[triangles[t + k]].second);
+		}
+		// The comment stays with the first triangle
+		if (t == 0 && p < end) {
+			out.put(' ');
+			out.write(p, end - p);
+		}
+		out.put('\n');
+	}
+	++polygons;
+	created += triangles.size() / 3;
+	return true;
+}
+
+void FaceTriangulator::report(Report& report) const {
+	report.add("Split faces", polygons);
+	report.add("Triangles", created);
+}
+
+void triangulate(Mesh& mesh, Report* report) {
+	const Elements& faces = mesh.faces;
+	size_t extra = 0;
+	for (size_t i = 0; i < faces.size(); ++i)
+		if (faces.corners(i) > 3) extra += faces.corners(i) - 3;
+	if (!extra) {
+		if (report) {
+			report->add("Split faces", 0);
+			report->add("Triangles", 0);
+		}
+		return;
+	}
+
+	Elements result(&mesh.arena);
+	result.offsets.reserve(faces.size() + extra + 1);
+	result.v.reserve(faces.v.size() + 2 * extra);
+	result.vt.reserve(faces.v.size() + 2 * extra);
+	result.vn.reserve(faces.v.size() + 2 * extra);
+	result.dirty.resize(faces.size() + extra);
+	result.relative.resize(faces.size() + extra);
+	Array<Record> records(ArenaAllocator<Record>(&mesh.arena));
+	records.reserve(mesh.records.size() + extra);
+
+	std::vector<vec3> corners;
+	std::vector<uint32_t> triangles;
+	uint64_t polygons = 0, created = 0;
+	for (const Record& record : mesh.records) {
+		if (record.kind != RecordFace) {
+			records.push_back(record);
+			continue;
+		}
+		Index first = faces.offsets[record.index], count = faces.corners(record.index);
+		triangles.clear();
+		if (count > 3) {
+			corners.resize(count);
+			for (Index c = 0; c < count; ++c) {
+				Index v = faces.v[first + c];
+				corners[c] = vec3(mesh.px[v], mesh.py[v], mesh.pz[v]);
+			}
+			triangulatePolygon(&corners[0], count, triangles);
+			++polygons;
+			created += triangles.size() / 3;
+		} else {
+			for (Index c = 0; c < count; ++c) triangles.push_back(c);
+		}
+		for (size_t t = 0; t < triangles.size() || t == 0; t += 3) {
+			Index face = result.size();
+			size_t size = count > 3 ? 3 : count;
+			for (size_t k = 0; k < size; ++k) {
+				Index c = first + triangles[t + k];
+				result.v.push_back(faces.v[c]);
+				result.vt.push_back(faces.vt[c]);
+				result.vn.push_back(faces.vn[c]);
+			}
+			result.offsets.push_back(result.v.size());
+			if (count > 3 || faces.dirty.test(record.index)) result.dirty.set(face);
+			if (faces.relative.test(record.index)) result.relative.set(face);
+			records.push_back(Record{ t == 0 ? record.line : NoLine, face, RecordFace });
+		}
+	}
+	std::swap(mesh.faces, result);
+	std::swap(mesh.records, records);
+	mesh.updateRanges();
+	if (report) {
+		report->add("Split faces", polygons);
+		report->add("Triangles", created);
+	}
+}
+
+} // namespace objmagic
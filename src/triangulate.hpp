@@ -0,0 +1,45 @@
+#pragma once
+
+// Splitting of polygons into triangles
+
+#include <vector>
+#include <string>
+
+#include "../glm/vec3.hpp"
+#include "objmagic.hpp"
+#include "parse.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Appends the corners of the triangles covering the polygon to out, three at a time,
+// keeping the winding. Convex quads are split along the shorter diagonal, other convex
+// polygons into a fan and concave ones by ear clipping in the plane they mostly lie on.
+void triangulatePolygon(const glm::vec3* corners, size_t count, std::vector<uint32_t>& out);
+
+// Triangulates f records as they stream past. Positions of the vertices read so far are
+// spooled in memory (12 bytes per vertex) for the polygons that need them.
+class FaceTriangulator {
+public:
+	void addVertex(const glm::vec3& position) { positions.push_back(position); }
+
+	// Writes the f record row, split into triangles if it has more than three corners.
+	// Corner positions are looked up with the indices of indexRow, which resolve against
+	// sofar and may differ from those of row when they are renumbered.
+	bool write(const char* indexRow, size_t indexLen, const char* row, size_t len, const ElementCounts& sofar, Sink& out);
+
+	void report(Report& report) const;
+
+private:
+	std::vector<glm::vec3> positions;
+	std::vector<uint64_t> tuples;
+	std::vector<glm::vec3> corners;
+	std::vector<uint32_t> triangles;
+	std::vector<std::pair<const char*, size_t>> tokens;
+	uint64_t polygons = 0, created = 0;
+};
+
+// Triangulates the faces of the mesh
+void triangulate(Mesh& mesh, Report* report);
+
+} // namespace objmagic
@@ -0,0 +1,35 @@
+#pragma once
+
+// Comparisons of glm vectors within a tolerance, per component, and spatial sort keys
+
+#include <cstdint>
+
+#include "../glm/vec3.hpp"
+#include "../glm/common.hpp"
+
+#define EPSILON 0.00001f
+
+namespace objmagic {
+
+template<typename T> inline bool isZero(T v, float epsilon = EPSILON) {
+	v = glm::abs(v);
+	return v.x < epsilon && v.y < epsilon && v.z < epsilon;
+}
+template<typename T> inline bool isOne(T v, float epsilon = EPSILON) { return isZero(v - T(1), epsilon); }
+template<typename T> inline bool isEqual(T a, T b, float epsilon = EPSILON) { return isZero(a - b, epsilon); }
+
+// Position along a Z-order curve of a point given relative to its bounds (0 to 1 per axis),
+// with 10 bits per axis. Sorting by it keeps points that are close together close together.
+inline uint32_t mortonCode(glm::vec3 unit) {
+	auto spread = [](float x) {
+		uint32_t v = (uint32_t)glm::clamp(x * 1024.0f, 0.0f, 1023.0f);
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	};
+	return spread(unit.x) << 2 | spread(unit.y) << 1 | spread(unit.z);
+}
+
+} // namespace objmagic
@@ -0,0 +1,233 @@
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "vertexcache.hpp"
+
+namespace objmagic {
+
+namespace {
+
+const int FifoSize = 16;  // For the stats, like typical hardware
+const int CacheSize = 32; // Modeled by the optimizer
+const float CacheDecayPower = 1.5f;
+const float LastTriangleScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, Index remaining) {
+	if (remaining == 0) return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) score = LastTriangleScore;
+		else score = std::pow(1.0f - float(cachePosition - 3) / (CacheSize - 3), CacheDecayPower);
+	}
+	return score + ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+}
+
+std::string format(double value) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%.3f", value);
+	return tmp;
+}
+
+// Faces [first, first + count) in an order that keeps their vertices in cache.
+// Vertex data is kept per render vertex and reset after use, so runs can share it.
+struct Forsyth {
+	const Mesh& mesh;
+	const RenderVertices& vertices;
+	std::vector<int> cachePosition;
+	std::vector<Index> remaining;
+	std::vector<float> score;
+	std::vector<Index> offsets; // CSR of run faces around each local vertex
+	std::vector<Index> adjacent;
+	std::vector<Index> local;   // Render vertex to local vertex in the current run
+	std::vector<Index> globals;
+
+	Forsyth(const Mesh& mesh, const RenderVertices& vertices):
+		mesh(mesh), vertices(vertices), local(vertices.count, NoIndex) {}
+
+	void run(Index first, Index count, Array<Index>& order) {
+		const Elements& faces = mesh.faces;
+		// Local vertex numbering and adjacency
+		globals.clear();
+		for (Index c = faces.offsets[first]; c < faces.offsets[first + count]; ++c) {
+			Index r = vertices.corners[c];
+			if (local[r] == NoIndex) {
+				local[r] = globals.size();
+				globals.push_back(r);
+			}
+		}
+		size_t n = globals.size();
+		offsets.assign(n + 1, 0);
+		for (Index c = faces.offsets[first]; c < faces.offsets[first + count]; ++c)
+			++offsets[local[vertices.corners[c]] + 1];
+		for (size_t v = 0; v < n; ++v) offsets[v + 1] += offsets[v];
+		adjacent.resize(offsets[n]);
+		remaining.assign(n, 0);
+		for (Index f = 0; f < count; ++f) {
+			for (Index c = faces.offsets[first + f]; c < faces.offsets[first + f + 1]; ++c) {
+				Index v = local[vertices.corners[c]];
+				adjacent[offsets[v] + remaining[v]++] = f;
+			}
+		}
+		cachePosition.assign(n, -1);
+		score.resize(n);
+		for (size_t v = 0; v < n; ++v) score[v] = vertexScore(-1, remaining[v]);
+
+		std::vector<float> faceScore(count, 0.0f);
+		std::vector<bool> emitted(count, false);
+		auto corners = [&](Index f) { return std::make_pair(faces.offsets[first + f], faces.offsets[first + f + 1]); };
+		for (Index f = 0; f < count; ++f) {
+			auto range = corners(f);
+			for (Index c = range.first; c < range.second; ++c)
+				faceScore[f] += score[local[vertices.corners[c]]];
+		}
+
+		std::vector<Index> cache, next;
+		Index best = NoIndex, scan = 0;
+		for (Index done = 0; done < count; ++done) {
+			if (best == NoIndex) {
+				while (emitted[scan]) ++scan;
+				best = scan;
+			}
+			Index face = best;
+			emitted[face] = true;
+			order.push_back(first + face);
+
+			// Face vertices go to the front of the cache
+			next.clear();
+			auto range = corners(face);
+			for (Index c = range.first; c < range.second; ++c) {
+				Index v = local[vertices.corners[c]];
+				if (std::find(next.begin(), next.end(), v) == next.end()) next.push_back(v);
+				Index* begin = &adjacent[offsets[v]];
+				Index* end = begin + remaining[v];
+				*std::find(begin, end, face) = end[-1];
+				--remaining[v];
+			}
+			for (Index v : cache)
+				if (std::find(next.begin(), next.end(), v) == next.end()) next.push_back(v);
+			for (size_t i = CacheSize; i < next.size(); ++i) {
+				cachePosition[next[i]] = -1;
+				updateScore(next[i], faceScore);
+			}
+			if (next.size() > (size_t)CacheSize) next.resize(CacheSize);
+			cache.swap(next);
+
+			// Rescore vertices in the cache and pick the best face touching them
+			for (size_t i = 0; i < cache.size(); ++i) {
+				cachePosition[cache[i]] = i;
+				updateScore(cache[i], faceScore);
+			}
+			best = NoIndex;
+			float bestScore = -1.0f;
+			for (Index v : cache) {
+				for (Index a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+					Index f = adjacent[a];
+					if (faceScore[f] > bestScore) {
+						bestScore = faceScore[f];
+						best = f;
+					}
+				}
+			}
+		}
+		for (Index r : globals) local[r] = NoIndex;
+	}
+
+	void updateScore(Index v, std::vector<float>& faceScore) {
+		float updated = vertexScore(cachePosition[v], remaining[v]);
+		float delta = updated - score[v];
+		score[v] = updated;
+		for (Index a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+			faceScore[adjacent[a]] += delta;
+	}
+};
+
+} // namespace
+
+RenderVertices::RenderVertices(const Mesh& mesh) {
+	const Elements& faces = mesh.faces;
+	corners.resize(faces.v.size());
+	size_t capacity = 16;
+	while (capacity < faces.v.size() * 2) capacity *= 2;
+	std::vector<Index> table(capacity, NoIndex);
+	size_t mask = capacity - 1;
+	auto hash = [&faces](Index c) {
+		uint64_t h = (uint64_t)faces.v[c] * 0x9E3779B97F4A7C15ull;
+		h ^= (uint64_t)faces.vt[c] * 0xC2B2AE3D27D4EB4Full;
+		h ^= (uint64_t)faces.vn[c] * 0x165667B19E3779F9ull;
+		return h ^ (h >> 31);
+	};
+	std::vector<Index> representative; // First corner of each render vertex
+	for (size_t c = 0; c < faces.v.size(); ++c) {
+		size_t slot = hash(c) & mask;
+		for (;; slot = (slot + 1) & mask) {
+			Index r = table[slot];
+			if (r == NoIndex) {
+				table[slot] = representative.size();
+				corners[c] = representative.size();
+				representative.push_back(c);
+				break;
+			}
+			Index o = representative[r];
+			if (faces.v[o] == faces.v[c] && faces.vt[o] == faces.vt[c] && faces.vn[o] == faces.vn[c]) {
+				corners[c] = r;
+				break;
+			}
+		}
+	}
+	count = representative.size();
+}
+
+CacheStats cacheStats(const Mesh& mesh, const RenderVertices& vertices) {
+	const Elements& faces = mesh.faces;
+	std::vector<uint64_t> stamp(vertices.count, 0); // Time a vertex entered the cache, 0 if never
+	uint64_t time = 0, misses = 0, triangles = 0;
+	auto draw = [&](Index r) {
+		if (stamp[r] && time - stamp[r] < FifoSize) return;
+		stamp[r] = ++time;
+		++misses;
+	};
+	for (size_t f = 0; f < faces.size(); ++f) {
+		Index first = faces.offsets[f];
+		for (Index i = 1; i + 1 < faces.corners(f); ++i) {
+			draw(vertices.corners[first]);
+			draw(vertices.corners[first + i]);
+			draw(vertices.corners[first + i + 1]);
+			++triangles;
+		}
+	}
+	CacheStats stats;
+	if (triangles) stats.acmr = double(misses) / triangles;
+	if (vertices.count) stats.atvr = double(misses) / vertices.count;
+	return stats;
+}
+
+void reportCacheStats(const Mesh& mesh, Report& report) {
+	CacheStats stats = cacheStats(mesh, RenderVertices(mesh));
+	report.add("ACMR", format(stats.acmr));
+	report.add("ATVR", format(stats.atvr));
+}
+
+void optimizeVertexCache(Mesh& mesh, Report* report) {
+	RenderVertices vertices(mesh);
+	CacheStats before = cacheStats(mesh, vertices);
+
+	Array<Index> order;
+	order.reserve(mesh.faces.size());
+	Forsyth forsyth(mesh, vertices);
+	for (const Range& run : mesh.faceRuns())
+		forsyth.run(run.first, run.count, order);
+	mesh.permuteFaces(order);
+
+	if (report) {
+		CacheStats after = cacheStats(mesh, RenderVertices(mesh));
+		report->add("ACMR before", format(before.acmr));
+		report->add("ACMR after", format(after.acmr));
+		report->add("ATVR before", format(before.atvr));
+		report->add("ATVR after", format(after.atvr));
+	}
+}
+
+} // namespace objmagic
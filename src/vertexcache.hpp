@@ -0,0 +1,34 @@
+#pragma once
+
+// Face ordering for the post-transform vertex cache of GPUs
+
+#include <vector>
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// GPU vertices: faces corners numbered by their distinct (v, vt, vn) tuples
+struct RenderVertices {
+	std::vector<Index> corners; // Per face corner
+	size_t count = 0;
+
+	explicit RenderVertices(const Mesh& mesh);
+};
+
+// Average cache miss ratio (misses per triangle) and average transformed vertex ratio
+// (misses per distinct vertex) of drawing the faces in order, as fans, through a FIFO cache
+struct CacheStats {
+	double acmr = 0.0, atvr = 0.0;
+};
+CacheStats cacheStats(const Mesh& mesh, const RenderVertices& vertices);
+
+// Adds the cache stats of the faces in their current order to the report, for --info
+void reportCacheStats(const Mesh& mesh, Report& report);
+
+// Reorders the faces of every run of faces (see Mesh::faceRuns) for vertex cache hits
+// using Forsyth's linear-speed algorithm. Reports the cache stats before and after.
+void optimizeVertexCache(Mesh& mesh, Report* report);
+
+} // namespace objmagic
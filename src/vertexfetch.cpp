@@ -0,0 +1,102 @@
+#include <vector>
+
+#include "vertexfetch.hpp"
+
+namespace objmagic {
+
+namespace {
+
+// Puts element order[i] in place i in each of the arrays and the dirty flags
+void permute(const std::vector<Index>& order, Bitset& dirty, Array<float>* const arrays[], int count) {
+	std::vector<float> tmp(order.size());
+	for (int a = 0; a < count; ++a) {
+		Array<float>& array = *arrays[a];
+		for (size_t i = 0; i < order.size(); ++i) tmp[i] = array[order[i]];
+		std::copy(tmp.begin(), tmp.end(), array.begin());
+	}
+	Bitset moved;
+	moved.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		if (dirty.test(order[i])) moved.set(i);
+	for (size_t i = 0; i < order.size(); ++i) {
+		if (moved.test(i)) dirty.set(i);
+		else dirty.reset(i);
+	}
+}
+
+} // namespace
+
+void optimizeVertexFetch(Mesh& mesh, Report* report) {
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	const size_t counts[] = { mesh.vertexCount(), mesh.texCoordCount(), mesh.normalCount() };
+	std::vector<Index> newIndex[3], order[3];
+	for (int k = 0; k < 3; ++k) {
+		newIndex[k].assign(counts[k], NoIndex);
+		order[k].reserve(counts[k]);
+	}
+
+	// Order of first use by the elements in file order, so no element refers to a record after
+	// it when the source didn't, then the unreferenced ones
+	for (const Record& record : mesh.records) {
+		int l = record.kind == RecordFace ? 0 : record.kind == RecordLine ? 1 : record.kind == RecordPoint ? 2 : -1;
+		if (l < 0) continue;
+		const Elements& list = *lists[l];
+		const Array<Index>* const corners[] = { &list.v, &list.vt, &list.vn };
+		for (Index c = list.offsets[record.index]; c < list.offsets[record.index + 1]; ++c) {
+			for (int k = 0; k < 3; ++k) {
+				Index index = (*corners[k])[c];
+				if (index == NoIndex || newIndex[k][index] != NoIndex) continue;
+				newIndex[k][index] = order[k].size();
+				order[k].push_back(index);
+			}
+		}
+	}
+	uint64_t moved[3] = {};
+	for (int k = 0; k < 3; ++k) {
+		for (size_t i = 0; i < counts[k]; ++i) {
+			if (newIndex[k][i] != NoIndex) continue;
+			newIndex[k][i] = order[k].size();
+			order[k].push_back(i);
+		}
+		for (size_t i = 0; i < counts[k]; ++i)
+			if (order[k][i] != i) ++moved[k];
+	}
+
+	Array<float>* const vertexArrays[] = { &mesh.px, &mesh.py, &mesh.pz };
+	Array<float>* const texCoordArrays[] = { &mesh.tu, &mesh.tv };
+	Array<float>* const normalArrays[] = { &mesh.nx, &mesh.ny, &mesh.nz };
+	permute(order[0], mesh.vertexDirty, vertexArrays, 3);
+	permute(order[1], mesh.texCoordDirty, texCoordArrays, 2);
+	permute(order[2], mesh.normalDirty, normalArrays, 3);
+
+	for (Elements* list : lists) {
+		Array<Index>* const corners[] = { &list->v, &list->vt, &list->vn };
+		for (size_t i = 0; i < list->size(); ++i) {
+			for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+				for (int k = 0; k < 3; ++k) {
+					Index& index = (*corners[k])[c];
+					if (index == NoIndex || newIndex[k][index] == index) continue;
+					index = newIndex[k][index];
+					list->dirty.set(i);
+				}
+			}
+		}
+	}
+
+	// Records keep their places, moved values can't be copied from the source line
+	for (Record& record : mesh.records) {
+		int k = record.kind == RecordVertex ? 0 : record.kind == RecordTexCoord ? 1 : record.kind == RecordNormal ? 2 : -1;
+		if (k >= 0 && order[k][record.index] != record.index)
+			record.line = NoLine;
+	}
+	if (moved[0] || moved[1] || moved[2])
+		mesh.renumbered = true;
+
+	if (report) {
+		report->add("Moved v", moved[0]);
+		report->add("Moved vt", moved[1]);
+		report->add("Moved vn", moved[2]);
+	}
+}
+
+} // namespace objmagic
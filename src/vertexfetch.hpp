@@ -0,0 +1,15 @@
+#pragma once
+
+// Ordering of vertex data for fetch locality
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Renumbers vertices, texture coordinates and normals in the order faces, lines and points
+// first refer to them, going through the elements in file order, and moves their values
+// accordingly while the records keep their places. Unreferenced ones go last.
+void optimizeVertexFetch(Mesh& mesh, Report* report);
+
+} // namespace objmagic
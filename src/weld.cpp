@@ -0,0 +1,172 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "weld.hpp"
+#include "clean.hpp"
+#include "vecmath.hpp"
+#include "threadpool.hpp"
+
+using namespace glm;
+
+namespace objmagic {
+
+namespace {
+
+// Cell of the uniform grid, with cells as large as the tolerance so that
+// every vertex within it is in the same or a neighboring cell
+struct Cell {
+	int64_t x, y, z;
+
+	Cell(vec3 p, float size) {
+		const double limit = 1e15;
+		x = (int64_t)std::max(-limit, std::min(limit, std::floor((double)p.x / size)));
+		y = (int64_t)std::max(-limit, std::min(limit, std::floor((double)p.y / size)));
+		z = (int64_t)std::max(-limit, std::min(limit, std::floor((double)p.z / size)));
+	}
+
+	uint64_t hash() const {
+		uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull ^ (uint64_t)y * 0xC2B2AE3D27D4EB4Full ^ (uint64_t)z * 0x165667B19E3779F9ull;
+		return h ^ (h >> 29);
+	}
+};
+
+} // namespace
+
+void weld(Mesh& mesh, float epsilon, bool keepSeams, ThreadPool& pool, Report* report) {
+	size_t count = mesh.vertexCount();
+	auto position = [&mesh](size_t i) { return vec3(mesh.px[i], mesh.py[i], mesh.pz[i]); };
+
+	// Distinct texture coordinate and normal values of the corners using each vertex, sorted, in
+	// CSR form, for keeping seams: the (vt, vn) pairs of vertex i start at attributeOffsets[i]
+	// and distinct[i] of them are used. Vertices are only merged if they have the same ones.
+	std::vector<size_t> attributeOffsets;
+	std::vector<Index> attributes, distinct;
+	auto attributeLess = [&](size_t a, size_t b) {
+		Index ta = attributes[a], tb = attributes[b], na = attributes[a + 1], nb = attributes[b + 1];
+		if ((ta == NoIndex) != (tb == NoIndex)) return ta == NoIndex;
+		if (ta != NoIndex && (mesh.tu[ta] != mesh.tu[tb] || mesh.tv[ta] != mesh.tv[tb]))
+			return mesh.tu[ta] != mesh.tu[tb] ? mesh.tu[ta] < mesh.tu[tb] : mesh.tv[ta] < mesh.tv[tb];
+		if ((na == NoIndex) != (nb == NoIndex)) return na == NoIndex;
+		if (na == NoIndex) return false;
+		if (mesh.nx[na] != mesh.nx[nb]) return mesh.nx[na] < mesh.nx[nb];
+		if (mesh.ny[na] != mesh.ny[nb]) return mesh.ny[na] < mesh.ny[nb];
+		return mesh.nz[na] < mesh.nz[nb];
+	};
+	if (keepSeams) {
+		const Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+		attributeOffsets.assign(count + 1, 0);
+		for (const Elements* list : lists)
+			for (Index v : list->v) attributeOffsets[v + 1] += 2;
+		for (size_t i = 0; i < count; ++i) attributeOffsets[i + 1] += attributeOffsets[i];
+		attributes.resize(attributeOffsets[count]);
+		distinct.resize(count);
+		std::vector<size_t> fill(attributeOffsets.begin(), attributeOffsets.end() - 1);
+		for (const Elements* list : lists) {
+			for (size_t c = 0; c < list->v.size(); ++c) {
+				size_t& at = fill[list->v[c]];
+				attributes[at++] = list->vt[c];
+				attributes[at++] = list->vn[c];
+			}
+		}
+		parallelFor(pool, count, 1 << 14, [&](size_t begin, size_t end) {
+			std::vector<size_t> pairs;
+			std::vector<Index> sorted;
+			for (size_t i = begin; i < end; ++i) {
+				pairs.clear();
+				for (size_t a = attributeOffsets[i]; a < attributeOffsets[i + 1]; a += 2) pairs.push_back(a);
+				std::sort(pairs.begin(), pairs.end(), attributeLess);
+				sorted.clear();
+				for (size_t k = 0; k < pairs.size(); ++k) {
+					if (k && !attributeLess(pairs[k - 1], pairs[k])) continue; // Same values
+					sorted.push_back(attributes[pairs[k]]);
+					sorted.push_back(attributes[pairs[k] + 1]);
+				}
+				std::copy(sorted.begin(), sorted.end(), attributes.begin() + attributeOffsets[i]);
+				distinct[i] = sorted.size() / 2;
+			}
+		});
+	}
+	auto attributesMatch = [&](size_t a, size_t b) {
+		if (!keepSeams) return true;
+		if (distinct[a] != distinct[b]) return false;
+		for (size_t k = 0; k < 2 * (size_t)distinct[a]; k += 2) {
+			size_t ia = attributeOffsets[a] + k, ib = attributeOffsets[b] + k;
+			if (attributeLess(ia, ib) || attributeLess(ib, ia)) return false;
+		}
+		return true;
+	};
+
+	// Vertices bucketed by cell hash in CSR form, in index order within each bucket
+	size_t buckets = 16;
+	while (buckets < count && buckets < (1ull << 32)) buckets *= 2;
+	size_t mask = buckets - 1;
+	std::vector<uint32_t> bucketOf(count);
+	parallelFor(pool, count, 1 << 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			bucketOf[i] = Cell(position(i), epsilon).hash() & mask;
+	});
+	std::vector<Index> offsets(buckets + 1);
+	for (size_t i = 0; i < count; ++i)
+		++offsets[bucketOf[i] + 1];
+	for (size_t b = 0; b < buckets; ++b)
+		offsets[b + 1] += offsets[b];
+	std::vector<Index> entries(count);
+	{
+		std::vector<Index> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < count; ++i)
+			entries[fill[bucketOf[i]]++] = i;
+	}
+	std::vector<uint32_t>().swap(bucketOf);
+
+	// Lowest numbered vertex within tolerance, searched independently for each vertex
+	std::vector<Index> target(count);
+	parallelFor(pool, count, 1 << 14, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			vec3 p = position(i);
+			Cell cell(p, epsilon);
+			Index best = i;
+			for (int dx = -1; dx <= 1; ++dx) for (int dy = -1; dy <= 1; ++dy) for (int dz = -1; dz <= 1; ++dz) {
+				Cell neighbor = cell;
+				neighbor.x += dx; neighbor.y += dy; neighbor.z += dz;
+				size_t b = neighbor.hash() & mask;
+				for (Index e = offsets[b]; e < offsets[b + 1]; ++e) {
+					Index j = entries[e];
+					if (j >= best) break;
+					if (isEqual(p, position(j), epsilon) && attributesMatch(i, j)) best = j;
+				}
+			}
+			target[i] = best;
+		}
+	});
+
+	// Resolve chains in index order, targets always come first
+	Bitset keep;
+	keep.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		target[i] = target[target[i]];
+		if (target[i] == i) keep.set(i);
+	}
+
+	Elements* const lists[] = { &mesh.faces, &mesh.lines, &mesh.points };
+	for (Elements* list : lists) {
+		for (size_t i = 0; i < list->size(); ++i) {
+			for (Index c = list->offsets[i]; c < list->offsets[i + 1]; ++c) {
+				if (target[list->v[c]] == list->v[c]) continue;
+				list->v[c] = target[list->v[c]];
+				list->dirty.set(i);
+			}
+		}
+	}
+
+	Bitset all[2];
+	all[0].resize(mesh.texCoordCount());
+	all[1].resize(mesh.normalCount());
+	for (Bitset& bits : all)
+		for (size_t i = 0; i < bits.size(); ++i) bits.set(i);
+	Remap v(keep), vt(all[0]), vn(all[1]);
+	if (report) report->add("Welded v", v.removedCount());
+	removeElements(mesh, v, vt, vn);
+}
+
+} // namespace objmagic
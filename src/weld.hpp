@@ -0,0 +1,16 @@
+#pragma once
+
+// Merging of vertices closer than a tolerance
+
+#include "objmagic.hpp"
+#include "mesh.hpp"
+
+namespace objmagic {
+
+// Points every vertex to the lowest numbered vertex within epsilon on each axis (following
+// chains of such vertices) and removes the rest. With keepSeams, vertices are only merged if
+// the corners using them have the same distinct texture coordinate and normal values, compared
+// exactly, so that vertices on either side of a seam stay apart.
+void weld(Mesh& mesh, float epsilon, bool keepSeams, ThreadPool& pool, Report* report);
+
+} // namespace objmagic